@@ -34,99 +34,581 @@ run
 #include <unordered_map>
 #include <unordered_set>
 #include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <type_traits>
 #include <cctype>
 #include <algorithm>
 #include <chrono>
 #include <functional>
+#include <memory>
+#include <charconv>
+#include <string_view>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#if defined(__GNUC__)
+#define ROS_NOINLINE __attribute__((noinline))
+#define ROS_INLINE inline __attribute__((always_inline))
+#else
+#define ROS_NOINLINE
+#define ROS_INLINE inline
+#endif
+// the jits' machine-code templates assume the 16-byte tagged value, so a NaN-boxed build runs without them
+#if defined(__x86_64__) && defined(__linux__) && !defined(ROS_NAN_BOXING)
+#include <sys/mman.h>
+#define ROS_BASELINE_JIT 1
+#endif
+#include <utility>
+// --compile runs the c++ driver directly from an argv vector, never through a shell
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <process.h>
+#endif
 using namespace std;
 
+enum ValueType : unsigned char { TYPE_NONE, TYPE_FLOAT, TYPE_INT, TYPE_DOUBLE, TYPE_BOOL, TYPE_STRING, TYPE_LIST };
+
+struct ROSdatatype;
+
+// immutable text shared by every value copied from it. Short text sits in the std::string's own inline
+// buffer, so one allocation holds the whole object. Interned strings are unique per text and never freed,
+// which lets == and != on two of them compare pointers.
+struct StringObject {
+    unsigned refs = 1;
+    bool interned = false;
+    string text;
+};
+
+StringObject* shareString(StringObject* str) { if (!str->interned) ++str->refs; return str; }
+void dropString(StringObject* str) { if (!str->interned && --str->refs == 0) delete str; }
+
+bool sameString(const StringObject& a, const StringObject& b) {
+    if (&a == &b) return true;
+    if (a.interned && b.interned) return false;
+    return a.text == b.text;
+}
+
+// list storage shared by every value copied from the same list; no operation writes to a list, so the
+// buffer is read-only and copying a list value only bumps refs
+struct ListBuffer {
+    unsigned refs = 1;
+    vector<ROSdatatype> items;
+};
+
+ListBuffer* shareList(ListBuffer* list) { ++list->refs; return list; }
+void dropList(ListBuffer* list) { if (--list->refs == 0) delete list; }
+
+#ifndef ROS_NAN_BOXING
+
+// 16 bytes: a type tag plus an inline float/int/double/bool or a shared string/list
+struct ROSdatatype {
+    ValueType tag = TYPE_NONE;
+    union {
+        float f;
+        int64_t i;
+        double d;
+        bool b;
+        StringObject* s;
+        ListBuffer* l;
+    } payload; // the jit templates read and write these in place
+
+    ROSdatatype() { payload.f = 0.0f; }
+    ROSdatatype(const ROSdatatype& other) { copyFrom(other); }
+    ROSdatatype(ROSdatatype&& other) noexcept { takeFrom(other); }
+    ~ROSdatatype() { release(); }
+    ROSdatatype& operator=(const ROSdatatype& other) { if (this != &other) { release(); copyFrom(other); } return *this; }
+    ROSdatatype& operator=(ROSdatatype&& other) noexcept { if (this != &other) { release(); takeFrom(other); } return *this; }
+
+    ValueType type() const { return tag; }
+    float floatValue() const { return payload.f; }
+    int64_t intValue() const { return payload.i; }
+    double doubleValue() const { return payload.d; }
+    bool boolValue() const { return payload.b; }
+    const string& stringValue() const { return payload.s->text; }
+    const StringObject& stringObject() const { return *payload.s; }
+    const vector<ROSdatatype>& listValue() const { return payload.l->items; }
+
+    // overwrite a number in place; the value must already hold that kind
+    void setFloat(float x) { payload.f = x; }
+    void setInt(int64_t x) { payload.i = x; }
+    void setDouble(double x) { payload.d = x; }
+
+private:
+    void release() {
+        if (tag == TYPE_STRING) dropString(payload.s);
+        else if (tag == TYPE_LIST) dropList(payload.l);
+        tag = TYPE_NONE;
+    }
+    void copyFrom(const ROSdatatype& other) {
+        tag = other.tag;
+        if (tag == TYPE_STRING) payload.s = shareString(other.payload.s);
+        else if (tag == TYPE_LIST) payload.l = shareList(other.payload.l);
+        else payload.i = other.payload.i; // floats, ints, doubles and bools all fit the 8-byte payload
+    }
+    void takeFrom(ROSdatatype& other) {
+        tag = other.tag;
+        payload.i = other.payload.i;
+        other.tag = TYPE_NONE;
+    }
+};
+
+ROSdatatype makeFloat(float f) { ROSdatatype r; r.tag = TYPE_FLOAT; r.payload.f = f; return r; }
+ROSdatatype makeInt(int64_t i) { ROSdatatype r; r.tag = TYPE_INT; r.payload.i = i; return r; }
+ROSdatatype makeDouble(double d) { ROSdatatype r; r.tag = TYPE_DOUBLE; r.payload.d = d; return r; }
+ROSdatatype makeBool(bool b) { ROSdatatype r; r.tag = TYPE_BOOL; r.payload.b = b; return r; }
+ROSdatatype makeString(string s) { ROSdatatype r; r.payload.s = new StringObject{1, false, move(s)}; r.tag = TYPE_STRING; return r; }
+ROSdatatype makeString(StringObject* str) { ROSdatatype r; r.payload.s = shareString(str); r.tag = TYPE_STRING; return r; }
+ROSdatatype makeList(vector<ROSdatatype> items) { ROSdatatype r; r.payload.l = new ListBuffer{1, move(items)}; r.tag = TYPE_LIST; return r; }
+
+#else
+
+// 8 bytes, NaN-boxed (built with -DROS_NAN_BOXING): a double is stored as itself, everything else in the
+// low 48 bits of a negative quiet NaN whose bits 48-50 name the box. Real NaNs are canonicalized so they
+// never look boxed, and ints that need more than 48 bits go to the heap.
+enum BoxTag : uint64_t { BOX_NONE = 1, BOX_FLOAT, BOX_INT, BOX_BOOL, BOX_STRING, BOX_LIST, BOX_BIGINT };
+
+const uint64_t boxPayloadMask = 0x0000FFFFFFFFFFFFull;
+const uint64_t firstBoxed = 0xFFF9000000000000ull; // anything below is a double
+
+constexpr uint64_t boxWord(BoxTag box, uint64_t payload) { return 0xFFF8000000000000ull | box << 48 | (payload & boxPayloadMask); }
+
 struct ROSdatatype {
-    bool isVariable = false;
-    string type; // "float", "string", "bool", "list"
-    string stringValue;
-    float floatValue = 0.0f;
-    bool boolValue = false;
-    vector<ROSdatatype> listValue;
+    uint64_t bits = boxWord(BOX_NONE, 0);
+
+    ROSdatatype() {}
+    ROSdatatype(const ROSdatatype& other) { copyFrom(other); }
+    ROSdatatype(ROSdatatype&& other) noexcept : bits(other.bits) { other.bits = boxWord(BOX_NONE, 0); }
+    ~ROSdatatype() { release(); }
+    ROSdatatype& operator=(const ROSdatatype& other) { if (this != &other) { release(); copyFrom(other); } return *this; }
+    ROSdatatype& operator=(ROSdatatype&& other) noexcept { if (this != &other) { release(); bits = other.bits; other.bits = boxWord(BOX_NONE, 0); } return *this; }
+
+    BoxTag box() const { return bits < firstBoxed ? BoxTag(0) : BoxTag(bits >> 48 & 7); }
+    void* pointer() const { return reinterpret_cast<void*>(static_cast<uintptr_t>(bits & boxPayloadMask)); }
+
+    ValueType type() const {
+        static constexpr ValueType kinds[8] = { TYPE_DOUBLE, TYPE_NONE, TYPE_FLOAT, TYPE_INT, TYPE_BOOL, TYPE_STRING, TYPE_LIST, TYPE_INT };
+        return kinds[box()];
+    }
+    float floatValue() const { uint32_t low = (uint32_t)bits; float f; memcpy(&f, &low, sizeof f); return f; }
+    int64_t intValue() const { return box() == BOX_BIGINT ? *static_cast<int64_t*>(pointer()) : (int64_t)(bits << 16) >> 16; }
+    double doubleValue() const { double d; memcpy(&d, &bits, sizeof d); return d; }
+    bool boolValue() const { return bits & 1; }
+    const string& stringValue() const { return static_cast<StringObject*>(pointer())->text; }
+    const StringObject& stringObject() const { return *static_cast<StringObject*>(pointer()); }
+    const vector<ROSdatatype>& listValue() const { return static_cast<ListBuffer*>(pointer())->items; }
+
+    static bool fitsInline(int64_t x) { return (int64_t)((uint64_t)x << 16) >> 16 == x; }
+    static uint64_t doubleWord(double x) {
+        if (x != x) return 0x7FF8000000000000ull;
+        uint64_t word;
+        memcpy(&word, &x, sizeof word);
+        return word;
+    }
+
+    void setFloat(float x) { uint32_t low; memcpy(&low, &x, sizeof low); bits = boxWord(BOX_FLOAT, low); }
+    void setInt(int64_t x) {
+        if (box() == BOX_BIGINT) { release(); bits = boxWord(BOX_INT, 0); }
+        if (fitsInline(x)) bits = boxWord(BOX_INT, (uint64_t)x);
+        else bits = boxWord(BOX_BIGINT, reinterpret_cast<uintptr_t>(new int64_t(x)));
+    }
+    void setDouble(double x) { bits = doubleWord(x); }
+
+private:
+    void release() {
+        switch (box()) {
+            case BOX_STRING: dropString(static_cast<StringObject*>(pointer())); break;
+            case BOX_LIST: dropList(static_cast<ListBuffer*>(pointer())); break;
+            case BOX_BIGINT: delete static_cast<int64_t*>(pointer()); break;
+            default: break;
+        }
+        bits = boxWord(BOX_NONE, 0);
+    }
+    void copyFrom(const ROSdatatype& other) {
+        switch (other.box()) {
+            case BOX_STRING: bits = boxWord(BOX_STRING, reinterpret_cast<uintptr_t>(shareString(static_cast<StringObject*>(other.pointer())))); break;
+            case BOX_LIST: bits = boxWord(BOX_LIST, reinterpret_cast<uintptr_t>(shareList(static_cast<ListBuffer*>(other.pointer())))); break;
+            case BOX_BIGINT: bits = boxWord(BOX_BIGINT, reinterpret_cast<uintptr_t>(new int64_t(other.intValue()))); break;
+            default: bits = other.bits; break;
+        }
+    }
+};
+
+ROSdatatype makeFloat(float f) { ROSdatatype r; r.setFloat(f); return r; }
+ROSdatatype makeInt(int64_t i) { ROSdatatype r; r.setInt(i); return r; }
+ROSdatatype makeDouble(double d) { ROSdatatype r; r.setDouble(d); return r; }
+ROSdatatype makeBool(bool b) { ROSdatatype r; r.bits = boxWord(BOX_BOOL, b); return r; }
+ROSdatatype makeString(string s) { ROSdatatype r; r.bits = boxWord(BOX_STRING, reinterpret_cast<uintptr_t>(new StringObject{1, false, move(s)})); return r; }
+ROSdatatype makeString(StringObject* str) { ROSdatatype r; r.bits = boxWord(BOX_STRING, reinterpret_cast<uintptr_t>(shareString(str))); return r; }
+ROSdatatype makeList(vector<ROSdatatype> items) { ROSdatatype r; r.bits = boxWord(BOX_LIST, reinterpret_cast<uintptr_t>(new ListBuffer{1, move(items)})); return r; }
+
+#endif
+
+// literals and one-character strings are looked up here so equal texts share one interned object. The
+// table is never destroyed: values in globals may still point at its strings while the program exits.
+unordered_map<string_view, StringObject*>& internedStrings = *new unordered_map<string_view, StringObject*>;
+StringObject* singleChars[256];
+
+StringObject* internedText(string s) {
+    auto it = internedStrings.find(s);
+    if (it != internedStrings.end()) return it->second;
+    StringObject* str = new StringObject{1, true, move(s)};
+    internedStrings.emplace(str->text, str);
+    return str;
+}
+
+ROSdatatype internString(string s) { return makeString(internedText(move(s))); }
+
+ROSdatatype charString(char c) {
+    StringObject*& str = singleChars[(unsigned char)c];
+    if (!str) str = internedText(string(1, c));
+    return makeString(str);
+}
+
+string typeName(ValueType type) {
+    switch (type) {
+        case TYPE_FLOAT: return "float";
+        case TYPE_INT: return "int";
+        case TYPE_DOUBLE: return "double";
+        case TYPE_BOOL: return "bool";
+        case TYPE_STRING: return "string";
+        case TYPE_LIST: return "list";
+        default: return "none";
+    }
+}
+
+// the kind decimal literals and float results take: TYPE_FLOAT, or TYPE_DOUBLE when started with --double
+ValueType realType = TYPE_FLOAT;
+
+ROSdatatype makeReal(double x) { return realType == TYPE_DOUBLE ? makeDouble(x) : makeFloat((float)x); }
+
+// the numeric kernels are written once over Num (float or double) and instantiated for both
+template <typename Num> constexpr ValueType realKind = is_same_v<Num, double> ? TYPE_DOUBLE : TYPE_FLOAT;
+
+template <typename Num> Num realOf(const ROSdatatype& v) {
+    if constexpr (is_same_v<Num, double>) return v.doubleValue();
+    else return v.floatValue();
+}
+template <typename Num> void setReal(ROSdatatype& v, Num x) {
+    if constexpr (is_same_v<Num, double>) v.setDouble(x);
+    else v.setFloat(x);
+}
+
+template <typename Num> ROSdatatype makeNumber(Num x) {
+    if constexpr (is_same_v<Num, double>) return makeDouble(x);
+    else return makeFloat(x);
+}
+
+// any numeric value widened or narrowed to Num
+template <typename Num> Num asReal(const ROSdatatype& v) {
+    if (v.type() == TYPE_INT) return (Num)v.intValue();
+    if (v.type() == TYPE_DOUBLE) return (Num)v.doubleValue();
+    return (Num)v.floatValue();
+}
+
+struct functionData;
+struct Chunk;
+struct RegChunk;
+
+// resolved call target, revalidated only when some function is (re)defined
+struct CallSiteCache {
+    functionData* target = nullptr;
+    unsigned epoch = 0;
+};
+
+// where a name lives once resolved: a slot in the current function's frame or in the global table
+struct VarRef {
+    bool local = false;
+    int slot = -1;
+};
+
+enum Operator : unsigned char {
+    OPR_INDEX,
+    OPR_INC, OPR_DEC,
+    OPR_NOT,
+    OPR_MUL, OPR_DIV, OPR_IDIV,
+    OPR_ADD, OPR_SUB,
+    OPR_LT, OPR_LE, OPR_GT, OPR_GE,
+    OPR_EQ, OPR_NE,
+    OPR_AND,
+    OPR_OR,
+    OPR_COUNT
+};
+
+// parsed expression tree, built once per source expression by parseExpression
+struct ExprNode {
+    enum Kind { Literal, Variable, Unary, Binary, Call, Invalid };
+    Kind kind = Invalid;
+    string text; // variable/function name, operator, or parse error
+    Operator op = OPR_COUNT; // Unary and Binary nodes
+    int constant = -1; // Literal: index into constantPool
+    VarRef var; // Variable nodes, filled in by resolveProgram
+    int symbol = -1; // interned variable/function name
+    mutable CallSiteCache call; // Call nodes
+    bool callFree = false; // no Call node below, so the walker evaluates it without tasks
+    mutable Chunk* code = nullptr; // call-free roots: op list compiled on first walker evaluation
+    vector<unique_ptr<ExprNode>> args; // operands or call arguments
+};
+typedef unique_ptr<ExprNode> ExprPtr;
+
+enum StmtKind : unsigned char { STMT_EMPTY, STMT_CALL, STMT_VAR, STMT_GLOBAL, STMT_DEF, STMT_RETURN, STMT_WHILE, STMT_FOR, STMT_END, STMT_HELP };
+
+// one source line after the front-end pass; tokens and expressions are parsed once at load time
+struct Statement {
+    string line;
+    vector<string> tokens;
+    StmtKind kind = STMT_EMPTY; // decoded from tokens[0] at load time; any non-keyword is a possible call
+    vector<string> names; // var name, def params, for init/inc targets
+    vector<VarRef> targets; // resolved var name / for init and inc targets
+    vector<ExprPtr> exprs; // var/return value, while cond, for init/cond/inc, standalone call
+    bool callMissingSpace = false;
+    int endIndex = -1; // matching "end" for def/while/for
+    int parent = -1; // header of the innermost enclosing def/while/for; for "end", the block it closes
+    int frameSize = 0; // def: number of local slots in the body
+    int symbol = -1; // interned def name, or tokens[0] for a possible call
+    functionData* function = nullptr; // def: function object built at load time
+    mutable unsigned backEdges = 0; // top-level while/for run by the walker: iterations so far
+    mutable const RegChunk* osrChunk = nullptr; // ... and the compiled loop it moves to once hot
 };
 
-struct ContextStackItem {
-    bool isWhile = false;
-    bool isFor = false;
-    int forBeginLine = 0;
-    int whileBeginLine = 0;
-    unordered_map<string, ROSdatatype> thisContextScopeVars;
+enum OpCode : unsigned char {
+    OP_CONST,         // push constantPool[a]
+    OP_LOAD_LOCAL,    // push frame slot a (symbol b is reported if unset)
+    OP_LOAD_GLOBAL,   // push global slot a (symbol b is reported if unset)
+    OP_STORE_LOCAL,   // pop into frame slot a
+    OP_STORE_GLOBAL,  // pop into global slot a
+    OP_POP,
+    OP_UNARY,         // apply Operator a to the top of stack
+    OP_BINARY,        // apply Operator a to the top two values; c counts executions with both operands of one numeric type
+    // OP_BINARY quickened for two floats, ints or doubles; a guard reverts to OP_BINARY when the operand types change
+    OP_ADD_FF, OP_SUB_FF, OP_MUL_FF, OP_LT_FF, OP_LE_FF, OP_GT_FF, OP_GE_FF, OP_EQ_FF, OP_NE_FF,
+    OP_ADD_II, OP_SUB_II, OP_MUL_II, OP_LT_II, OP_LE_II, OP_GT_II, OP_GE_II, OP_EQ_II, OP_NE_II,
+    OP_ADD_DD, OP_SUB_DD, OP_MUL_DD, OP_LT_DD, OP_LE_DD, OP_GT_DD, OP_GE_DD, OP_EQ_DD, OP_NE_DD,
+    // superinstructions set by fuseSuperinstructions on a LOAD that starts a fusable sequence
+    OP_LOCAL_CMP_BRANCH, OP_GLOBAL_CMP_BRANCH, // LOAD; CONST; compare; JUMP_IF_FALSE
+    OP_LOCAL_ADD_STORE, OP_GLOBAL_ADD_STORE,   // LOAD x; CONST; ADD or SUB; STORE x
+    OP_JUMP_IF_FALSE, // pop condition, jump to a if falsy
+    OP_LOOP,          // jump back to a, or to b if an error is pending
+    OP_CHECK_FUNC,    // jump to b when symbol a is not a function
+    OP_CALL,          // call symbol a with b arguments from the stack
+    OP_RETURN,
+    OP_DEF,           // bind symbol a to protos[b]
+    OP_HELP,
+    OP_ERROR,         // report names[a] and push an empty value
+    OP_HALT
 };
 
+struct Instr {
+    OpCode op;
+    int a = 0;
+    int b = 0;
+    int c = 0; // CALL: index into Chunk::callSites; BINARY: quickening counter
+    int line = 0;
+};
+
+// compiled form of a program or function body
+struct Chunk {
+    mutable vector<Instr> code; // operator instructions rewrite themselves as they run
+    vector<string> names; // error messages referenced by code
+    vector<functionData*> protos; // functions defined in this chunk
+    mutable vector<CallSiteCache> callSites;
+};
+
+// function object: built once per def (or builtin) and shared by pointer, never copied per call
 struct functionData {
-    vector<string> body;
-    int numArgs;
+    const vector<Statement>* program = nullptr;
+    int bodyBegin = 0;
+    int bodyEnd = 0;
+    int numArgs = 0; // -1 = variadic (cfunc only)
+    int numSlots = 0; // params occupy slots 0..numArgs-1
     vector<string> argNames;
     bool isC = false;
     function<ROSdatatype(const vector<ROSdatatype>&)> cfunc;
+    Chunk* chunk = nullptr; // compiled on first use by the vm engine
+    RegChunk* regChunk = nullptr; // likewise for the register vm
 };
 
 void print(const string& str) { cout << str << endl; }
 
-string input(const string& prompt) {
-    string got;
-    cout << prompt;
-    getline(cin, got);
-    return got;
-}
+// every identifier is interned to a small id once at load time; globals and functions are dense tables indexed by it
+unordered_map<string, int> symbolIds;
+vector<string> symbolNames;
+
+vector<ROSdatatype> variables; // global scope, indexed by symbol id; TYPE_NONE = never assigned
 
-vector<ContextStackItem> ContextStack;
-unordered_map<string, ROSdatatype> variables; // global scope
+// literal values, decoded once by the lexer and shared by every expression and chunk that uses them
+vector<ROSdatatype> constantPool;
+unordered_map<string, int> constantIds; // type tag + payload bytes -> index, so equal literals share a slot
 int lineIndex = 0;
 bool hasErrored = false;
 
-vector<unordered_map<string, ROSdatatype>> LocalScopeStack;
-int InFunctionDepth = 0;
-vector<bool> ReturnFlagStack;
-vector<ROSdatatype> ReturnValueStack;
+// pending expression node in the walker; next counts operands already pushed to valueStack
+struct EvalTask {
+    const ExprNode* node = nullptr;
+    size_t next = 0;
+};
+
+// one activation on the explicit call stack, shared by both engines so deep recursion never grows the C++ stack
+struct Frame {
+    const functionData* function = nullptr; // null for the top level
+    size_t slotBase = 0; // first local in frameSlots
+    size_t valueBase = 0; // valueStack height on entry, arguments already removed
+    size_t taskBase = 0;
+    bool savedError = false;
+    int savedLine = 0;
+    // walker
+    const vector<Statement>* program = nullptr;
+    int pc = 0;
+    int end = 0;
+    int phase = 0; // progress within statement pc
+    // vm
+    const Chunk* chunk = nullptr;
+    const RegChunk* regChunk = nullptr; // register vm
+    size_t ip = 0;
+};
+
+vector<Frame> frames;
+vector<ROSdatatype> frameSlots; // locals of every active call, back to back
+size_t localBase = 0; // slotBase of frames.back()
+vector<ROSdatatype> valueStack; // walker intermediate values and vm operand stack
+vector<EvalTask> evalTasks;
+
+vector<unique_ptr<functionData>> functionObjects; // owns every function object; kept alive for stale call sites and frames
+vector<functionData*> functions; // indexed by symbol id; null = not defined
+unsigned functionsEpoch = 1; // bumped on every definition so call-site caches revalidate
+
+int internSymbol(const string& name) {
+    auto it = symbolIds.find(name);
+    if (it != symbolIds.end()) return it->second;
+    int id = (int)symbolNames.size();
+    symbolIds[name] = id;
+    symbolNames.push_back(name);
+    variables.emplace_back();
+    functions.emplace_back();
+    return id;
+}
+
+int internConstant(const ROSdatatype& value) {
+    string key(1, (char)value.type());
+    float f = value.floatValue();
+    int64_t i = value.intValue();
+    double d = value.doubleValue();
+    if (value.type() == TYPE_FLOAT) key.append(reinterpret_cast<const char*>(&f), sizeof f);
+    else if (value.type() == TYPE_INT) key.append(reinterpret_cast<const char*>(&i), sizeof i);
+    else if (value.type() == TYPE_DOUBLE) key.append(reinterpret_cast<const char*>(&d), sizeof d);
+    else if (value.type() == TYPE_BOOL) key += value.boolValue() ? '1' : '0';
+    else if (value.type() == TYPE_STRING) key += value.stringValue();
+    auto it = constantIds.find(key);
+    if (it != constantIds.end()) return it->second;
+    constantPool.push_back(value);
+    return constantIds[key] = (int)constantPool.size() - 1;
+}
+
+functionData* lookupFunction(int symbol) {
+    return symbol >= 0 ? functions[symbol] : nullptr;
+}
+
+functionData* resolveCall(CallSiteCache& cache, int symbol) {
+    if (cache.epoch != functionsEpoch) {
+        cache.target = lookupFunction(symbol);
+        cache.epoch = functionsEpoch;
+    }
+    return cache.target;
+}
+
+functionData* newFunction() {
+    functionObjects.push_back(unique_ptr<functionData>(new functionData()));
+    return functionObjects.back().get();
+}
 
-unordered_map<string, functionData> functions;
+void defineFunction(int symbol, functionData* func) {
+    functions[symbol] = func;
+    functionsEpoch++;
+}
+vector<unique_ptr<vector<Statement>>> loadedPrograms; // kept alive so functions from earlier runs stay callable
 
-vector<unordered_set<string>> GlobalMarkStack; // per-function set of names marked global
+enum OperatorForm : unsigned char { FORM_BINARY, FORM_PREFIX, FORM_SUFFIX };
 
-const vector<vector<string>> precedence = {
-    {"index"},
-    {"++", "--"},
-    {"not"},
-    {"*", "/", "//"},
-    {"+", "-"},
-    {"<", "<=", ">", ">="},
-    {"==", "!="},
-    {"and"},
-    {"or"}
+struct OperatorInfo {
+    const char* text;
+    int level; // precedence, 0 binds tightest
+    OperatorForm form;
 };
 
-const vector<string> binaryOP {
-    "+", "-", "/", "//", ">", "<", "==", "!=", ">=", "<=", "and", "or", "*", "index"
+// indexed by Operator
+constexpr OperatorInfo operatorTable[OPR_COUNT] = {
+    { "index", 0, FORM_BINARY },
+    { "++", 1, FORM_SUFFIX }, { "--", 1, FORM_SUFFIX },
+    { "not", 2, FORM_PREFIX },
+    { "*", 3, FORM_BINARY }, { "/", 3, FORM_BINARY }, { "//", 3, FORM_BINARY },
+    { "+", 4, FORM_BINARY }, { "-", 4, FORM_BINARY },
+    { "<", 5, FORM_BINARY }, { "<=", 5, FORM_BINARY }, { ">", 5, FORM_BINARY }, { ">=", 5, FORM_BINARY },
+    { "==", 6, FORM_BINARY }, { "!=", 6, FORM_BINARY },
+    { "and", 7, FORM_BINARY },
+    { "or", 8, FORM_BINARY }
 };
-const vector<string> unaryOP_prefix { "not" };
-const vector<string> unaryOP_suffix { "++", "--" };
+constexpr int precedenceLevels = 9;
 
 void error(const string& msg) {
     cerr << "Error: " << msg << " at line " << lineIndex << endl;
     hasErrored = true;
 }
 
-bool isNumber(const string& s) {
+bool isNumber(string_view s) {
     if (s.empty()) return false;
     size_t i = 0;
     if (s[0] == '-' || s[0] == '+') i++;
-    bool dotSeen = false;
+    bool dotSeen = false, digitSeen = false;
     for (; i < s.size(); i++) {
         if (s[i] == '.') {
             if (dotSeen) return false;
             dotSeen = true;
         } else if (!isdigit(static_cast<unsigned char>(s[i]))) {
             return false;
-        }
+        } else digitSeen = true;
     }
+    return digitSeen;
+}
+
+// decimal text as accepted by isNumber; from_chars neither allocates nor consults the locale
+template <typename Num>
+bool parseNumber(string_view s, Num& out) {
+    if (!isNumber(s)) return false;
+    if (s[0] == '+') s.remove_prefix(1);
+    return from_chars(s.data(), s.data() + s.size(), out, chars_format::fixed).ec == errc();
+}
+
+// a number without a decimal point that fits in 64 bits
+bool parseInteger(string_view s, int64_t& out) {
+    if (!isNumber(s) || s.find('.') != string_view::npos) return false;
+    if (s[0] == '+') s.remove_prefix(1);
+    return from_chars(s.data(), s.data() + s.size(), out).ec == errc();
+}
+
+// decimal text parsed straight to the current real kind, so doubles are not rounded through float
+bool parseReal(string_view s, ROSdatatype& out) {
+    if (realType == TYPE_DOUBLE) { double d; if (!parseNumber(s, d)) return false; out = makeDouble(d); }
+    else { float f; if (!parseNumber(s, f)) return false; out = makeFloat(f); }
     return true;
 }
 
+// shortest-looking text at the type's own precision: 6 significant digits for float, 15 for double
+template <typename Num>
+string formatReal(Num x) {
+    ostringstream ss;
+    ss << setprecision(numeric_limits<Num>::digits10) << x;
+    return ss.str();
+}
+
 string strip(const string& str) {
     size_t start = 0;
     while (start < str.size() && isspace(static_cast<unsigned char>(str[start]))) start++;
@@ -170,722 +652,3209 @@ vector<string> tokenize(const string& str) {
     return tokens;
 }
 
-template <typename T>
-vector<T> slice(const vector<T>& v, size_t start, size_t end = (size_t)-1) {
-    if (end == (size_t)-1 || end > v.size()) end = v.size();
-    if (start > end) start = end;
-    return vector<T>(v.begin() + start, v.begin() + end);
-}
-
 string sliceStr(const string& s, size_t start, size_t end = (size_t)-1) {
     if (end == (size_t)-1 || end > s.size()) end = s.size();
     if (start > end) start = end;
     return string(s.begin() + start, s.begin() + end);
 }
 
-template <typename T>
-bool contains(const vector<T>& vec, const T& item) {
-    for (size_t i = 0; i < vec.size(); i++) if (vec[i] == item) return true;
-    return false;
-}
-
-ROSdatatype cast(const ROSdatatype& value, const string& targetType) {
-    ROSdatatype result;
-    if (targetType == "float") {
-        if (value.type == "float") result = value;
-        else if (value.type == "string" && isNumber(value.stringValue)) {
-            result.floatValue = stof(value.stringValue);
-            result.type = "float";
-        } else if (value.type == "bool") {
-            result.floatValue = value.boolValue ? 1.0f : 0.0f;
-            result.type = "float";
-        } else { error("Cannot cast type " + value.type + " to float"); }
-    }
-    else if (targetType == "string") {
-        if (value.type == "float") { ostringstream ss; ss << value.floatValue; result.stringValue = ss.str(); }
-        else if (value.type == "bool") result.stringValue = value.boolValue ? "true" : "false";
-        else if (value.type == "string") result.stringValue = value.stringValue;
-        else if (value.type == "list") {
-            string s = "[";
-            for (size_t i = 0; i < value.listValue.size(); i++) { s += cast(value.listValue[i], "string").stringValue; if (i + 1 < value.listValue.size()) s += ", "; }
-            s += "]";
-            result.stringValue = s;
-        }
-        result.type = "string";
-    }
-    else if (targetType == "bool") {
-        if (value.type == "bool") result.boolValue = value.boolValue;
-        else if (value.type == "float") result.boolValue = (value.floatValue != 0.0f);
-        else if (value.type == "string") result.boolValue = (!value.stringValue.empty());
-        else if (value.type == "list") result.boolValue = (!value.listValue.empty());
-        result.type = "bool";
-    }
-    else if (targetType == "list") {
-        if (value.type == "string") {
-            for (char c : value.stringValue) {
-                ROSdatatype ch; ch.type = "string"; ch.stringValue = string(1, c);
-                result.listValue.push_back(ch);
-            }
-            result.type = "list";
-        } else if (value.type == "list") result = value;
-        else error("Cannot cast " + value.type + " to list");
-    } else { error("Unknown target type: " + targetType); }
-    return result;
+// split on sep outside of parentheses and quotes
+vector<string> splitTopLevel(const string& s, char sep) {
+    vector<string> parts;
+    string cur;
+    int depth = 0;
+    char quoteChar = '\0';
+    for (char c : s) {
+        if (quoteChar) { if (c == quoteChar) quoteChar = '\0'; }
+        else if (c == '\'' || c == '"') quoteChar = c;
+        else if (c == '(') depth++;
+        else if (c == ')') depth--;
+        if (c == sep && depth == 0 && !quoteChar) { parts.push_back(strip(cur)); cur.clear(); }
+        else cur += c;
+    }
+    if (!strip(cur).empty() || !parts.empty()) parts.push_back(strip(cur));
+    return parts;
 }
 
-bool lookupVar(const string& name, ROSdatatype& out) {
-    for (int i = (int)LocalScopeStack.size() - 1; i >= 0; --i) {
-        auto& scope = LocalScopeStack[i];
-        auto it = scope.find(name);
-        if (it != scope.end()) { out = it->second; return true; }
+// "i = e" assigns e to i, "i + e" is shorthand for "i = i + e", anything else is evaluated and discarded
+void splitAssign(const string& s, string& name, string& exprStr) {
+    size_t eq = s.find('=');
+    vector<string> ts = tokenize(s);
+    if (eq != string::npos && s.compare(eq, 2, "==") != 0 && (eq == 0 || string("!<>").find(s[eq - 1]) == string::npos)) {
+        name = strip(sliceStr(s, 0, eq));
+        exprStr = strip(sliceStr(s, eq + 1));
+    } else if (ts.size() == 3 && ts[1] == "+") {
+        name = ts[0];
+        exprStr = s;
+    } else {
+        name.clear();
+        exprStr = s;
     }
-    auto itg = variables.find(name);
-    if (itg != variables.end()) { out = itg->second; return true; }
-    return false;
 }
 
-unordered_map<string, ROSdatatype>& currentScope() {
-    if (!LocalScopeStack.empty()) return LocalScopeStack.back();
-    return variables;
-}
+ExprPtr parseExpression(const string& expr);
 
-ROSdatatype parseValue(const string& valueStr) {
-    ROSdatatype r;
-    string s = valueStr;
-    if (isNumber(s)) { r.floatValue = stof(s); r.type = "float"; }
-    else if ((s.size() >= 2) && ((s.front() == '\'' && s.back() == '\'') || (s.front() == '"' && s.back() == '"'))) {
-        r.stringValue = s.substr(1, s.size() - 2); r.type = "string";
-    }
-    else if (s == "true" || s == "false") { r.type = "bool"; r.boolValue = (s == "true"); }
-    else {
-        ROSdatatype got;
-        if (lookupVar(s, got)) r = got;
-        else { error("cannot parse value: " + s); }
-    }
-    return r;
+struct KeywordEntry {
+    const char* text;
+    StmtKind kind;
+};
+
+// perfect hash: (first char + second char + length) & 15 is distinct for every keyword
+constexpr KeywordEntry keywordTable[16] = {
+    {}, { "help", STMT_HELP }, {}, {}, { "while", STMT_WHILE }, {}, { "end", STMT_END }, {},
+    { "for", STMT_FOR }, { "global", STMT_GLOBAL }, { "var", STMT_VAR }, {}, { "def", STMT_DEF }, { "return", STMT_RETURN }, {}, {}
+};
+
+StmtKind statementKind(const string& word) {
+    if (word.size() < 2) return STMT_CALL;
+    const KeywordEntry& entry = keywordTable[((unsigned char)word[0] + (unsigned char)word[1] + word.size()) & 15];
+    return entry.text && word == entry.text ? entry.kind : STMT_CALL;
 }
 
-vector<string> tokenizeExpression(const string& str) {
-    vector<string> tokens;
-    string current;
-    bool inQuote = false;
-    char quoteChar = '\0';
+// names assigned inside one def body; params take the first slots
+struct FunctionScope {
+    unordered_map<string, int> locals;
+    unordered_set<string> globals; // names listed in a "global" statement anywhere in the body
+};
 
-    vector<string> allOps;
-    for (auto &group : precedence) for (auto &op : group) allOps.push_back(op);
-    for (auto &op : unaryOP_prefix) allOps.push_back(op);
-    for (auto &op : unaryOP_suffix) allOps.push_back(op);
-    for (auto &op : binaryOP) allOps.push_back(op);
-    sort(allOps.begin(), allOps.end());
-    allOps.erase(unique(allOps.begin(), allOps.end()), allOps.end());
-    sort(allOps.begin(), allOps.end(), [](const string& a, const string& b){ return a.size() > b.size(); });
-
-    auto flushCurrent = [&]() {
-        if (!current.empty()) { tokens.push_back(current); current.clear(); }
-    };
+VarRef resolveName(const FunctionScope* scope, const string& name) {
+    VarRef ref;
+    if (scope && !scope->globals.count(name)) {
+        auto it = scope->locals.find(name);
+        if (it != scope->locals.end()) { ref.local = true; ref.slot = it->second; return ref; }
+    }
+    ref.slot = internSymbol(name);
+    return ref;
+}
 
-    for (size_t i = 0; i < str.size(); i++) {
-        char c = str[i];
+void resolveExpr(const FunctionScope* scope, ExprNode& node) {
+    if (node.kind == ExprNode::Variable || node.kind == ExprNode::Call) node.symbol = internSymbol(node.text);
+    if (node.kind == ExprNode::Variable) node.var = resolveName(scope, node.text);
+    node.callFree = node.kind != ExprNode::Call;
+    for (auto& arg : node.args) { resolveExpr(scope, *arg); node.callFree = node.callFree && arg->callFree; }
+}
 
-        if (inQuote) {
-            current += c;
-            if (c == quoteChar) {
-                tokens.push_back(current);
-                current.clear();
-                inQuote = false;
-                quoteChar = '\0';
+// give every name in [begin, end) a frame or global slot; scope is null at top level
+void resolveRange(vector<Statement>& program, int begin, int end, FunctionScope* scope) {
+    for (int i = begin; i < end; i++) {
+        Statement& st = program[i];
+        if (st.kind == STMT_EMPTY) continue;
+        if (st.kind == STMT_DEF) {
+            if (st.tokens.size() >= 2) st.symbol = internSymbol(st.tokens[1]);
+            FunctionScope inner;
+            auto declare = [&](const string& name) {
+                if (!name.empty() && !inner.locals.count(name)) { int slot = (int)inner.locals.size(); inner.locals[name] = slot; }
+            };
+            for (const string& param : st.names) declare(param);
+            // globals first, so a later "global x" still applies to an earlier "var x"
+            for (int j = i + 1; j < st.endIndex; j++) {
+                const Statement& body = program[j];
+                if (body.kind == STMT_GLOBAL && body.tokens.size() >= 2) inner.globals.insert(body.tokens[1]);
+                if (body.kind == STMT_DEF) j = body.endIndex;
+            }
+            for (int j = i + 1; j < st.endIndex; j++) {
+                const Statement& body = program[j];
+                if (body.kind == STMT_DEF) { j = body.endIndex; continue; }
+                if (body.kind == STMT_VAR || body.kind == STMT_FOR)
+                    for (const string& name : body.names) if (!inner.globals.count(name)) declare(name);
             }
+            resolveRange(program, i + 1, st.endIndex, &inner);
+            st.frameSize = (int)inner.locals.size();
+            if (st.symbol >= 0) {
+                st.function = newFunction();
+                st.function->program = &program;
+                st.function->bodyBegin = i + 1;
+                st.function->bodyEnd = st.endIndex;
+                st.function->argNames = st.names;
+                st.function->numArgs = (int)st.names.size();
+                st.function->numSlots = st.frameSize;
+            }
+            i = st.endIndex;
             continue;
         }
-
-        if (c == '"' || c == '\'') {
-            flushCurrent();
-            inQuote = true;
-            quoteChar = c;
-            current += c;
-            continue;
+        if (st.kind == STMT_CALL) st.symbol = internSymbol(st.tokens[0]);
+        st.targets.clear();
+        for (const string& name : st.names) {
+            if (st.kind == STMT_VAR || (st.kind == STMT_FOR && !name.empty())) st.targets.push_back(resolveName(scope, name));
+            else st.targets.push_back(VarRef());
         }
+        for (auto& expr : st.exprs) resolveExpr(scope, *expr);
+    }
+}
 
-        if (isspace(static_cast<unsigned char>(c))) {
-            flushCurrent();
-            continue;
-        }
+void resolveProgram(vector<Statement>& program) {
+    resolveRange(program, 0, (int)program.size(), nullptr);
+}
 
-        if (c == '(' || c == ')' || c == ',') {
-            flushCurrent();
-            tokens.push_back(string(1, c));
-            continue;
+// front-end pass: tokenize every line once and link every block to its "end"; the program is kept in loadedPrograms
+const vector<Statement>& compileProgram(const vector<string>& lines) {
+    loadedPrograms.push_back(unique_ptr<vector<Statement>>(new vector<Statement>(lines.size())));
+    vector<Statement>& program = *loadedPrograms.back();
+    vector<int> openBlocks;
+    for (size_t i = 0; i < lines.size(); i++) {
+        Statement& st = program[i];
+        st.line = lines[i];
+        st.parent = openBlocks.empty() ? -1 : openBlocks.back();
+        st.tokens = tokenize(st.line);
+        if (st.tokens.empty()) continue;
+        const string& cmd = st.tokens[0];
+        const string& line = st.line;
+        st.kind = statementKind(cmd);
+
+        if (st.kind == STMT_VAR) {
+            size_t eqpos = line.find('=');
+            if (st.tokens.size() >= 4 && st.tokens[2] == "=" && eqpos != string::npos) {
+                st.names.push_back(st.tokens[1]);
+                st.exprs.push_back(parseExpression(strip(sliceStr(line, eqpos + 1))));
+            }
         }
-
-        bool matched = false;
-        for (const string &op : allOps) {
-            size_t len = op.size();
-            if (len && i + len <= str.size() && str.compare(i, len, op) == 0) {
-                flushCurrent();
-                tokens.push_back(op);
-                i += len - 1;
-                matched = true;
-                break;
+        else if (st.kind == STMT_RETURN) {
+            st.exprs.push_back(parseExpression(strip(sliceStr(line, line.find("return") + 6))));
+        }
+        else if (st.kind == STMT_DEF) {
+            size_t lp = line.find("("), rp = line.find(")");
+            if (lp != string::npos && rp != string::npos && rp > lp) st.names = splitTopLevel(sliceStr(line, lp + 1, rp), ',');
+            openBlocks.push_back((int)i);
+        }
+        else if (st.kind == STMT_WHILE) {
+            size_t lp = line.find("("), rp = line.find_last_of(')');
+            if (lp != string::npos && rp != string::npos && rp > lp) st.exprs.push_back(parseExpression(strip(sliceStr(line, lp + 1, rp))));
+            openBlocks.push_back((int)i);
+        }
+        else if (st.kind == STMT_FOR) {
+            size_t lp = line.find("("), rp = line.find_last_of(')');
+            vector<string> parts;
+            if (lp != string::npos && rp != string::npos && rp > lp) parts = splitTopLevel(sliceStr(line, lp + 1, rp), ';');
+            if (parts.size() == 3) {
+                string init = parts[0];
+                if (init.rfind("var ", 0) == 0) init = strip(sliceStr(init, 4));
+                string initName, initExpr, incName, incExpr;
+                splitAssign(init, initName, initExpr);
+                splitAssign(parts[2], incName, incExpr);
+                st.names = { initName, incName };
+                st.exprs.push_back(parseExpression(initExpr));
+                st.exprs.push_back(parseExpression(parts[1]));
+                st.exprs.push_back(parseExpression(incExpr));
             }
+            openBlocks.push_back((int)i);
+        }
+        else if (st.kind == STMT_END) {
+            if (!openBlocks.empty()) { program[openBlocks.back()].endIndex = (int)i; openBlocks.pop_back(); }
+        }
+        else if (st.kind == STMT_CALL) {
+            // possible standalone call: "name (a, b)" or "name expr"
+            size_t pos = line.find(cmd) + cmd.size();
+            st.callMissingSpace = pos < line.size() && line[pos] == '(';
+            string rest = strip(sliceStr(line, pos));
+            ExprPtr call(new ExprNode());
+            call->kind = ExprNode::Call;
+            call->text = cmd;
+            if (!rest.empty() && rest[0] == '(') {
+                int depth = 0;
+                size_t close = string::npos;
+                for (size_t k = 0; k < rest.size() && close == string::npos; k++) {
+                    if (rest[k] == '(') depth++;
+                    else if (rest[k] == ')' && --depth == 0) close = k;
+                }
+                if (close == rest.size() - 1) { for (const string& arg : splitTopLevel(sliceStr(rest, 1, close), ',')) call->args.push_back(parseExpression(arg)); }
+                else call->args.push_back(parseExpression(rest));
+            }
+            else if (!rest.empty()) call->args.push_back(parseExpression(rest));
+            st.exprs.push_back(move(call));
         }
-        if (matched) continue;
-
-        current += c;
     }
-    flushCurrent();
-    return tokens;
+    // unterminated blocks are closed by implicit "end" lines after the last one, innermost first
+    while (!openBlocks.empty()) {
+        program.emplace_back();
+        program.back().tokens = { "end" };
+        program.back().kind = STMT_END;
+        program.back().parent = openBlocks.back();
+        program[openBlocks.back()].endIndex = (int)program.size() - 1;
+        openBlocks.pop_back();
+    }
+    resolveProgram(program);
+    return program;
 }
 
-static int __expr_placeholder_counter = 0;
+bool truthy(const ROSdatatype& v) {
+    switch (v.type()) {
+        case TYPE_BOOL: return v.boolValue();
+        case TYPE_FLOAT: return v.floatValue() != 0.0f;
+        case TYPE_INT: return v.intValue() != 0;
+        case TYPE_DOUBLE: return v.doubleValue() != 0.0;
+        case TYPE_STRING: return !v.stringValue().empty();
+        case TYPE_LIST: return !v.listValue().empty();
+        default: return false;
+    }
+}
 
-ROSdatatype callFunction(const string& fname, const vector<string>& argExprs);
+template <typename Num>
+ROSdatatype castReal(const ROSdatatype& value) {
+    Num number;
+    if (value.type() == TYPE_FLOAT || value.type() == TYPE_INT || value.type() == TYPE_DOUBLE) return makeNumber(asReal<Num>(value));
+    if (value.type() == TYPE_STRING && parseNumber(value.stringValue(), number)) return makeNumber(number);
+    if (value.type() == TYPE_BOOL) return makeNumber<Num>(value.boolValue() ? 1 : 0);
+    error("Cannot cast type " + typeName(value.type()) + " to " + typeName(realKind<Num>));
+    return ROSdatatype();
+}
 
-ROSdatatype binaryMath(const string& a, const string& op, const string& b) {
-    ROSdatatype Adata = parseValue(a);
-    ROSdatatype Bdata = parseValue(b);
+ROSdatatype cast(const ROSdatatype& value, ValueType targetType) {
     ROSdatatype result;
-
-    if (Adata.type == "float" && Bdata.type == "float") {
-        result.type = "float";
-        if (op == "+") result.floatValue = Adata.floatValue + Bdata.floatValue;
-        else if (op == "-") result.floatValue = Adata.floatValue - Bdata.floatValue;
-        else if (op == "*") result.floatValue = Adata.floatValue * Bdata.floatValue;
-        else if (op == "/") {
-            if (Bdata.floatValue == 0) { error("Division by zero"); std::exit(1); }
-            result.floatValue = Adata.floatValue / Bdata.floatValue;
-        }
-        else if (op == "//") {
-            if (Bdata.floatValue == 0) { error("Division by zero"); std::exit(1); }
-            result.floatValue = static_cast<int>(Adata.floatValue / Bdata.floatValue);
-        }
-        else if (op == "==") { result.type = "bool"; result.boolValue = (Adata.floatValue == Bdata.floatValue); }
-        else if (op == "!=") { result.type = "bool"; result.boolValue = (Adata.floatValue != Bdata.floatValue); }
-        else if (op == ">")  { result.type = "bool"; result.boolValue = (Adata.floatValue > Bdata.floatValue); }
-        else if (op == "<")  { result.type = "bool"; result.boolValue = (Adata.floatValue < Bdata.floatValue); }
-        else if (op == ">=") { result.type = "bool"; result.boolValue = (Adata.floatValue >= Bdata.floatValue); }
-        else if (op == "<=") { result.type = "bool"; result.boolValue = (Adata.floatValue <= Bdata.floatValue); }
-        else error("Unsupported float op: " + op);
-    }
-    else if (Adata.type == "string" && Bdata.type == "string") {
-        if (op == "+") { result.type = "string"; result.stringValue = Adata.stringValue + Bdata.stringValue; }
-        else if (op == "==") { result.type = "bool"; result.boolValue = (Adata.stringValue == Bdata.stringValue); }
-        else if (op == "!=") { result.type = "bool"; result.boolValue = (Adata.stringValue != Bdata.stringValue); }
-        else error("Unsupported string op: " + op);
-    }
-    else if (Adata.type == "string" && Bdata.type == "float" && op == "index") {
-        int idx = static_cast<int>(Bdata.floatValue);
-        if (idx < 0 || idx >= static_cast<int>(Adata.stringValue.size())) {
-            error("String index out of range");
-            return result;
-        }
-        result.type = "string";
-        result.stringValue = string(1, Adata.stringValue[idx]);
-    }
-    else if (Adata.type == "bool" && Bdata.type == "bool") {
-        result.type = "bool";
-        if (op == "and") result.boolValue = Adata.boolValue && Bdata.boolValue;
-        else if (op == "or") result.boolValue = Adata.boolValue || Bdata.boolValue;
-        else if (op == "==") result.boolValue = (Adata.boolValue == Bdata.boolValue);
-        else if (op == "!=") result.boolValue = (Adata.boolValue != Bdata.boolValue);
-        else error("Unsupported bool op: " + op);
+    double number;
+    int64_t integer;
+    if (targetType == TYPE_FLOAT) result = castReal<float>(value);
+    else if (targetType == TYPE_DOUBLE) result = castReal<double>(value);
+    else if (targetType == TYPE_INT) {
+        if (value.type() == TYPE_INT) result = value;
+        else if (value.type() == TYPE_FLOAT || value.type() == TYPE_DOUBLE) result = makeInt((int64_t)asReal<double>(value));
+        else if (value.type() == TYPE_STRING && parseInteger(value.stringValue(), integer)) result = makeInt(integer);
+        else if (value.type() == TYPE_STRING && parseNumber(value.stringValue(), number)) result = makeInt((int64_t)number);
+        else if (value.type() == TYPE_BOOL) result = makeInt(value.boolValue() ? 1 : 0);
+        else { error("Cannot cast type " + typeName(value.type()) + " to int"); }
     }
-    else {
-        error("Type mismatch for op " + op + ", with values: " + a + ", " + b);
+    else if (targetType == TYPE_STRING) {
+        if (value.type() == TYPE_FLOAT) result = makeString(formatReal(value.floatValue()));
+        else if (value.type() == TYPE_DOUBLE) result = makeString(formatReal(value.doubleValue()));
+        else if (value.type() == TYPE_INT) result = makeString(to_string(value.intValue()));
+        else if (value.type() == TYPE_BOOL) result = internString(value.boolValue() ? "true" : "false");
+        else if (value.type() == TYPE_STRING) result = value;
+        else if (value.type() == TYPE_LIST) {
+            const vector<ROSdatatype>& items = value.listValue();
+            string s = "[";
+            for (size_t i = 0; i < items.size(); i++) { s += cast(items[i], TYPE_STRING).stringValue(); if (i + 1 < items.size()) s += ", "; }
+            s += "]";
+            result = makeString(s);
+        }
+        else result = makeString("");
+    }
+    else if (targetType == TYPE_BOOL) {
+        result = makeBool(truthy(value));
     }
+    else if (targetType == TYPE_LIST) {
+        if (value.type() == TYPE_STRING) {
+            vector<ROSdatatype> items;
+            for (char c : value.stringValue()) items.push_back(charString(c));
+            result = makeList(move(items));
+        } else if (value.type() == TYPE_LIST) result = value;
+        else error("Cannot cast " + typeName(value.type()) + " to list");
+    } else { error("Unknown target type: " + typeName(targetType)); }
     return result;
 }
 
-ROSdatatype unaryMath(const string& a, const string& op) {
-    ROSdatatype Adata = parseValue(a);
-    ROSdatatype result;
+ROSdatatype& varSlot(const VarRef& ref) {
+    return ref.local ? frameSlots[localBase + ref.slot] : variables[ref.slot];
+}
 
-    if (Adata.type == "float") {
-        if (op == "++") { result.type = "float"; result.floatValue = Adata.floatValue + 1; }
-        else if (op == "--") { result.type = "float"; result.floatValue = Adata.floatValue - 1; }
-        else if (op == "not") { result.type = "bool"; result.boolValue = !(Adata.floatValue != 0); }
-        else error("Unsupported float unary op: " + op);
-    }
-    else if (Adata.type == "bool") {
-        if (op == "not") { result.type = "bool"; result.boolValue = !Adata.boolValue; }
-        else error("Unsupported bool unary op: " + op);
-    }
-    else if (Adata.type == "string") {
-        if (op == "not") { result.type = "bool"; result.boolValue = Adata.stringValue.empty(); }
-        else error("Unsupported string unary op: " + op);
-    }
-    else {
-        error("Unsupported type for unary op: " + Adata.type);
-    }
-    return result;
+// a local read before its first assignment still finds the global of the same name, as the dynamic
+// lookup did before slots; kept out of line so the error text is not built into every read
+ROS_NOINLINE const ROSdatatype& unsetLocal(int symbol) {
+    const ROSdatatype& global = variables[symbol];
+    if (global.type() == TYPE_NONE) error("cannot parse value: " + symbolNames[symbol]);
+    return global;
 }
 
-ROSdatatype expression(const string& expr) {
-    vector<string> tokens = tokenizeExpression(expr);
-    if (tokens.empty()) { error("Empty expression"); return ROSdatatype(); }
-    vector<string> placeholdersToErase;
+enum TokenKind : unsigned char { TOK_LITERAL, TOK_NAME, TOK_OPERATOR, TOK_LPAREN, TOK_RPAREN, TOK_COMMA, TOK_ERROR };
 
-    auto makePlaceholder = [&]() {
-        string name = "__EXPR_PLACEHOLDER__" + to_string(__expr_placeholder_counter++);
-        placeholdersToErase.push_back(name);
-        return name;
-    };
+// one lexeme of an expression; text is source[begin, end), quotes included for strings
+struct Token {
+    TokenKind kind = TOK_ERROR;
+    Operator op = OPR_COUNT; // TOK_OPERATOR
+    size_t begin = 0;
+    size_t end = 0;
+    int constant = -1; // TOK_LITERAL: index into constantPool
+    int symbol = -1; // TOK_NAME: interned identifier
+};
 
-    // resolve parentheses and function calls
-    for (int i = 0; i < (int)tokens.size(); i++) {
-        if (tokens[i] == "(") {
-            int depth = 1;
-            int j = i + 1;
-            while (j < (int)tokens.size() && depth > 0) {
-                if (tokens[j] == "(") depth++;
-                else if (tokens[j] == ")") depth--;
-                j++;
-            }
-            if (depth != 0) { error("Unmatched parenthesis"); return ROSdatatype(); }
+// symbol operator starting at s[i]; len is 0 when there is none
+Operator matchSymbolOperator(const string& s, size_t i, size_t& len) {
+    char next = i + 1 < s.size() ? s[i + 1] : '\0';
+    len = 2;
+    switch (s[i]) {
+        case '+': if (next == '+') return OPR_INC; len = 1; return OPR_ADD;
+        case '-': if (next == '-') return OPR_DEC; len = 1; return OPR_SUB;
+        case '*': len = 1; return OPR_MUL;
+        case '/': if (next == '/') return OPR_IDIV; len = 1; return OPR_DIV;
+        case '<': if (next == '=') return OPR_LE; len = 1; return OPR_LT;
+        case '>': if (next == '=') return OPR_GE; len = 1; return OPR_GT;
+        case '=': if (next == '=') return OPR_EQ; break;
+        case '!': if (next == '=') return OPR_NE; break;
+    }
+    len = 0;
+    return OPR_COUNT;
+}
 
-            vector<string> inner(tokens.begin() + i + 1, tokens.begin() + (j - 1));
-            string innerExpr;
-            for (size_t k = 0; k < inner.size(); k++) {
-                if (k) innerExpr += " ";
-                innerExpr += inner[k];
-            }
+// word operators only match a whole word, so names like "noret" or "order" stay identifiers
+Operator matchWordOperator(const char* w, size_t n) {
+    switch (n) {
+        case 2: if (w[0] == 'o' && w[1] == 'r') return OPR_OR; break;
+        case 3:
+            if (w[0] == 'a' && w[1] == 'n' && w[2] == 'd') return OPR_AND;
+            if (w[0] == 'n' && w[1] == 'o' && w[2] == 't') return OPR_NOT;
+            break;
+        case 5: if (string::traits_type::compare(w, "index", 5) == 0) return OPR_INDEX; break;
+    }
+    return OPR_COUNT;
+}
 
-            // function call if previous token exists and is a function name
-            if (i - 1 >= 0 && functions.count(tokens[i - 1])) {
-                string fname = tokens[i - 1];
+// single left-to-right pass; literals are decoded and names interned as they are read
+vector<Token> tokenizeExpression(const string& str) {
+    vector<Token> tokens;
+    size_t i = 0;
+    while (i < str.size()) {
+        char c = str[i];
+        if (isspace(static_cast<unsigned char>(c))) { i++; continue; }
 
-                // enforce mandatory space before '('
-                if (expr.find(fname + "(") != string::npos) {
-                    error("function calls require a space before '('");
-                    return ROSdatatype();
-                }
+        Token tok;
+        tok.begin = i;
+        size_t len = 0;
+        if (c == '"' || c == '\'') {
+            size_t close = str.find(c, i + 1);
+            if (close == string::npos) { tok.kind = TOK_ERROR; i = str.size(); }
+            else {
+                tok.kind = TOK_LITERAL;
+                tok.constant = internConstant(internString(str.substr(i + 1, close - i - 1)));
+                i = close + 1;
+            }
+        }
+        else if (c == '(' || c == ')' || c == ',') {
+            tok.kind = c == '(' ? TOK_LPAREN : c == ')' ? TOK_RPAREN : TOK_COMMA;
+            i++;
+        }
+        else if ((tok.op = matchSymbolOperator(str, i, len)) != OPR_COUNT) {
+            tok.kind = TOK_OPERATOR;
+            i += len;
+        }
+        else {
+            // a word runs until whitespace, a quote, a bracket, a comma or a symbol operator
+            while (i < str.size()) {
+                char w = str[i];
+                if (isspace(static_cast<unsigned char>(w)) || w == '"' || w == '\'' || w == '(' || w == ')' || w == ',') break;
+                if (matchSymbolOperator(str, i, len) != OPR_COUNT) break;
+                i++;
+            }
+            string_view word(str.data() + tok.begin, i - tok.begin);
+            ROSdatatype number;
+            int64_t integer;
+            if ((tok.op = matchWordOperator(word.data(), word.size())) != OPR_COUNT) tok.kind = TOK_OPERATOR;
+            else if (parseInteger(word, integer)) { tok.kind = TOK_LITERAL; tok.constant = internConstant(makeInt(integer)); }
+            else if (parseReal(word, number)) { tok.kind = TOK_LITERAL; tok.constant = internConstant(number); }
+            else if (word == "true" || word == "false") { tok.kind = TOK_LITERAL; tok.constant = internConstant(makeBool(word == "true")); }
+            else { tok.kind = TOK_NAME; tok.symbol = internSymbol(string(word)); }
+        }
+        tok.end = i;
+        tokens.push_back(tok);
+    }
+    return tokens;
+}
 
-                // parse arguments from innerExpr
-                vector<string> args;
-                string cur;
-                int d = 0;
-                for (char c : innerExpr) {
-                    if (c == '(') d++;
-                    else if (c == ')') d--;
-                    if (c == ',' && d == 0) { args.push_back(strip(cur)); cur.clear(); }
-                    else cur += c;
-                }
-                if (!cur.empty()) args.push_back(strip(cur));
 
-                // evaluate call
-                ROSdatatype callVal = callFunction(fname, args);
+// ---- operator kernels: one function per (left type, right type, operator), picked at compile time ----
 
-                string ph = makePlaceholder();
-                currentScope()[ph] = callVal;
+typedef ROSdatatype (*BinaryKernel)(const ROSdatatype&, const ROSdatatype&);
+typedef ROSdatatype (*UnaryKernel)(const ROSdatatype&);
+constexpr int valueTypeCount = TYPE_LIST + 1;
 
-                // replace fname, '(', inner..., ')' with placeholder
-                tokens.erase(tokens.begin() + (i - 1), tokens.begin() + j);
-                tokens.insert(tokens.begin() + (i - 1), ph);
-                i -= 1;
-            } else {
-                // normal parenthesized subexpression
-                ROSdatatype value = expression(innerExpr);
-                string ph = makePlaceholder();
-                currentScope()[ph] = value;
-                tokens.erase(tokens.begin() + i, tokens.begin() + j);
-                tokens.insert(tokens.begin() + i, ph);
-                i--;
-            }
-        }
-    }
-
-    // apply operators by precedence
-    for (const vector<string>& pass : precedence) {
-        for (int i = 0; i < (int)tokens.size(); i++) {
-            string token = tokens[i];
-            if (!contains(pass, token)) continue;
-
-            if (contains(unaryOP_prefix, token)) {
-                if (i + 1 >= (int)tokens.size()) { error("Missing operand for " + token); return ROSdatatype(); }
-                ROSdatatype value = unaryMath(tokens[i + 1], token);
-                string ph = makePlaceholder();
-                currentScope()[ph] = value;
-                tokens[i] = ph;
-                tokens.erase(tokens.begin() + (i + 1));
-                i--;
-                continue;
-            }
+string operatorText(Operator op) { return operatorTable[op].text; }
 
-            if (contains(unaryOP_suffix, token)) {
-                if (i == 0) { error("Missing operand for " + token); return ROSdatatype(); }
-                ROSdatatype value = unaryMath(tokens[i - 1], token);
-                string ph = makePlaceholder();
-                currentScope()[ph] = value;
-                tokens[i] = ph;
-                tokens.erase(tokens.begin() + (i - 1));
-                i--;
-                continue;
-            }
+template <typename Num, Operator op>
+ROSdatatype realArith(Num a, Num b) {
+    if constexpr (op == OPR_ADD) return makeNumber(a + b);
+    else if constexpr (op == OPR_SUB) return makeNumber(a - b);
+    else if constexpr (op == OPR_MUL) return makeNumber(a * b);
+    else if constexpr (op == OPR_DIV || op == OPR_IDIV) {
+        if (b == 0) { error("Division by zero"); std::exit(1); }
+        if constexpr (op == OPR_DIV) return makeNumber(a / b);
+        else return makeNumber<Num>(static_cast<int>(a / b));
+    }
+    else if constexpr (op == OPR_EQ) return makeBool(a == b);
+    else if constexpr (op == OPR_NE) return makeBool(a != b);
+    else if constexpr (op == OPR_GT) return makeBool(a > b);
+    else if constexpr (op == OPR_LT) return makeBool(a < b);
+    else if constexpr (op == OPR_GE) return makeBool(a >= b);
+    else if constexpr (op == OPR_LE) return makeBool(a <= b);
+    else { error("Unsupported " + typeName(realKind<Num>) + " op: " + operatorText(op)); return ROSdatatype(); }
+}
 
-            if (contains(binaryOP, token)) {
-                if (i == 0 || i + 1 >= (int)tokens.size()) { error("Missing operand for " + token); return ROSdatatype(); }
-                ROSdatatype value = binaryMath(tokens[i - 1], token, tokens[i + 1]);
-                string ph = makePlaceholder();
-                currentScope()[ph] = value;
-                tokens[i] = ph;
-                tokens.erase(tokens.begin() + (i + 1));
-                tokens.erase(tokens.begin() + (i - 1));
-                i--;
-                continue;
-            }
-        }
+template <typename Num, Operator op>
+ROSdatatype realBinary(const ROSdatatype& A, const ROSdatatype& B) { return realArith<Num, op>(realOf<Num>(A), realOf<Num>(B)); }
+
+// an int meeting a float is promoted to float, and anything meeting a double to double
+template <typename Num, Operator op>
+ROSdatatype mixedBinary(const ROSdatatype& A, const ROSdatatype& B) { return realArith<Num, op>(asReal<Num>(A), asReal<Num>(B)); }
+
+// ints wrap on overflow; "/" always divides as the real kind so 7 / 2 stays 3.5, "//" stays in ints
+template <Operator op>
+ROSdatatype intBinary(const ROSdatatype& A, const ROSdatatype& B) {
+    int64_t a = A.intValue(), b = B.intValue();
+    if constexpr (op == OPR_ADD) return makeInt((int64_t)((uint64_t)a + (uint64_t)b));
+    else if constexpr (op == OPR_SUB) return makeInt((int64_t)((uint64_t)a - (uint64_t)b));
+    else if constexpr (op == OPR_MUL) return makeInt((int64_t)((uint64_t)a * (uint64_t)b));
+    else if constexpr (op == OPR_DIV) return realType == TYPE_DOUBLE ? realArith<double, op>((double)a, (double)b) : realArith<float, op>((float)a, (float)b);
+    else if constexpr (op == OPR_IDIV) {
+        if (b == 0) { error("Division by zero"); std::exit(1); }
+        if (b == -1) return makeInt((int64_t)(0 - (uint64_t)a));
+        return makeInt(a / b);
     }
+    else if constexpr (op == OPR_EQ) return makeBool(a == b);
+    else if constexpr (op == OPR_NE) return makeBool(a != b);
+    else if constexpr (op == OPR_GT) return makeBool(a > b);
+    else if constexpr (op == OPR_LT) return makeBool(a < b);
+    else if constexpr (op == OPR_GE) return makeBool(a >= b);
+    else if constexpr (op == OPR_LE) return makeBool(a <= b);
+    else { error("Unsupported int op: " + operatorText(op)); return ROSdatatype(); }
+}
 
-    ROSdatatype result;
-    if (!tokens.empty() && tokens[0].find("__EXPR_PLACEHOLDER__") == 0) result = currentScope()[tokens[0]];
-    else result = parseValue(tokens[0]);
+template <Operator op>
+ROSdatatype stringBinary(const ROSdatatype& A, const ROSdatatype& B) {
+    if constexpr (op == OPR_ADD) {
+        string s;
+        s.reserve(A.stringValue().size() + B.stringValue().size());
+        s += A.stringValue();
+        s += B.stringValue();
+        return makeString(move(s));
+    }
+    else if constexpr (op == OPR_EQ) return makeBool(sameString(A.stringObject(), B.stringObject()));
+    else if constexpr (op == OPR_NE) return makeBool(!sameString(A.stringObject(), B.stringObject()));
+    else { error("Unsupported string op: " + operatorText(op)); return ROSdatatype(); }
+}
 
-    // cleanup placeholders
-    for (const auto& name : placeholdersToErase) {
-        auto& scope = currentScope();
-        auto it = scope.find(name);
-        if (it != scope.end()) scope.erase(it);
-        auto itg = variables.find(name);
-        if (itg != variables.end()) variables.erase(itg);
+ROSdatatype stringIndex(const ROSdatatype& A, const ROSdatatype& B) {
+    int64_t idx = B.type() == TYPE_INT ? B.intValue() : static_cast<int64_t>(asReal<double>(B));
+    if (idx < 0 || idx >= static_cast<int64_t>(A.stringValue().size())) {
+        error("String index out of range");
+        return ROSdatatype();
     }
+    return charString(A.stringValue()[idx]);
+}
 
-    return result;
+template <Operator op>
+ROSdatatype boolBinary(const ROSdatatype& A, const ROSdatatype& B) {
+    bool a = A.boolValue(), b = B.boolValue();
+    if constexpr (op == OPR_AND) return makeBool(a && b);
+    else if constexpr (op == OPR_OR) return makeBool(a || b);
+    else if constexpr (op == OPR_EQ) return makeBool(a == b);
+    else if constexpr (op == OPR_NE) return makeBool(a != b);
+    else { error("Unsupported bool op: " + operatorText(op)); return ROSdatatype(); }
 }
 
-ROSdatatype callFunction(const string& fname, const vector<string>& argExprs) {
-    functionData func = functions[fname];
-    if (func.isC) {
-        vector<ROSdatatype> args;
+template <Operator op>
+ROSdatatype typeMismatch(const ROSdatatype& A, const ROSdatatype& B) {
+    error("Type mismatch for op " + operatorText(op) + ", with values: " + cast(A, TYPE_STRING).stringValue() + ", " + cast(B, TYPE_STRING).stringValue());
+    return ROSdatatype();
+}
 
-        for (int i = 0; i < func.numArgs; i++) {
-            if (i < (int)argExprs.size()) {
-                args.push_back(expression(argExprs[i]));
-            } else {
-                ROSdatatype def; def.type = "float"; def.floatValue = 0.0f;
-                args.push_back(expression(argExprs[i]));
-            }
-        }
+constexpr bool isNumeric(ValueType t) { return t == TYPE_FLOAT || t == TYPE_INT || t == TYPE_DOUBLE; }
+
+template <ValueType L, ValueType R, Operator op>
+constexpr BinaryKernel selectBinary() {
+    if constexpr (L == TYPE_FLOAT && R == TYPE_FLOAT) return realBinary<float, op>;
+    else if constexpr (L == TYPE_DOUBLE && R == TYPE_DOUBLE) return realBinary<double, op>;
+    else if constexpr (L == TYPE_INT && R == TYPE_INT) return intBinary<op>;
+    else if constexpr (isNumeric(L) && isNumeric(R)) return mixedBinary<conditional_t<L == TYPE_DOUBLE || R == TYPE_DOUBLE, double, float>, op>;
+    else if constexpr (L == TYPE_STRING && R == TYPE_STRING) return stringBinary<op>;
+    else if constexpr (L == TYPE_STRING && isNumeric(R) && op == OPR_INDEX) return stringIndex;
+    else if constexpr (L == TYPE_BOOL && R == TYPE_BOOL) return boolBinary<op>;
+    else return typeMismatch<op>;
+}
 
-        return func.cfunc(args);
-        
-    }
+template <size_t... I>
+constexpr array<BinaryKernel, sizeof...(I)> makeBinaryKernels(index_sequence<I...>) {
+    return {{ selectBinary<ValueType(I / (valueTypeCount * OPR_COUNT)), ValueType(I / OPR_COUNT % valueTypeCount), Operator(I % OPR_COUNT)>()... }};
+}
 
-    
-    // push new local scope if not cfunc
-    LocalScopeStack.push_back(unordered_map<string, ROSdatatype>());
-    GlobalMarkStack.push_back(unordered_set<string>());
-    InFunctionDepth++;
-    ReturnFlagStack.push_back(false);
+// flattened [left type][right type][operator]
+constexpr auto binaryKernels = makeBinaryKernels(make_index_sequence<valueTypeCount * valueTypeCount * OPR_COUNT>());
 
+inline ROSdatatype binaryMath(const ROSdatatype& Adata, Operator op, const ROSdatatype& Bdata) {
+    return binaryKernels[(Adata.type() * valueTypeCount + Bdata.type()) * OPR_COUNT + op](Adata, Bdata);
+}
 
-    for (int i = 0; i < func.numArgs; i++) {
-        if (i < (int)argExprs.size()) {
-            currentScope()[func.argNames[i]] = expression(argExprs[i]);
-        } else {
-            ROSdatatype def; def.type = "float"; def.floatValue = 0.0f;
-            currentScope()[func.argNames[i]] = def;
-        }
+template <ValueType T, Operator op>
+ROSdatatype unaryKernel(const ROSdatatype& A) {
+    if constexpr (T == TYPE_FLOAT || T == TYPE_DOUBLE) {
+        using Num = conditional_t<T == TYPE_DOUBLE, double, float>;
+        if constexpr (op == OPR_INC) return makeNumber<Num>(realOf<Num>(A) + 1);
+        else if constexpr (op == OPR_DEC) return makeNumber<Num>(realOf<Num>(A) - 1);
+        else if constexpr (op == OPR_NOT) return makeBool(!(realOf<Num>(A) != 0));
+        else { error("Unsupported " + typeName(T) + " unary op: " + operatorText(op)); return ROSdatatype(); }
     }
-
-    int savedLine = lineIndex;
-    lineIndex = 0;
-    // execute function body
-    bool savedError = hasErrored;
-    hasErrored = false;
-    // Reuse execBlock to execute function body
-    // forward declaration
-    void execBlock(const vector<string>&);
-    execBlock(func.body);
-
-    ROSdatatype retVal;
-    if (!ReturnValueStack.empty()) {
-        retVal = ReturnValueStack.back();
-        ReturnValueStack.pop_back();
-    } else {
-        retVal.type = "float";
-        retVal.floatValue = 0.0f;
+    else if constexpr (T == TYPE_INT) {
+        if constexpr (op == OPR_INC) return makeInt((int64_t)((uint64_t)A.intValue() + 1));
+        else if constexpr (op == OPR_DEC) return makeInt((int64_t)((uint64_t)A.intValue() - 1));
+        else if constexpr (op == OPR_NOT) return makeBool(A.intValue() == 0);
+        else { error("Unsupported int unary op: " + operatorText(op)); return ROSdatatype(); }
+    }
+    else if constexpr (T == TYPE_BOOL) {
+        if constexpr (op == OPR_NOT) return makeBool(!A.boolValue());
+        else { error("Unsupported bool unary op: " + operatorText(op)); return ROSdatatype(); }
     }
-    if (!ReturnFlagStack.empty()) ReturnFlagStack.pop_back();
+    else if constexpr (T == TYPE_STRING) {
+        if constexpr (op == OPR_NOT) return makeBool(A.stringValue().empty());
+        else { error("Unsupported string unary op: " + operatorText(op)); return ROSdatatype(); }
+    }
+    else { error("Unsupported type for unary op: " + typeName(T)); return ROSdatatype(); }
+}
 
-    LocalScopeStack.pop_back();
-    GlobalMarkStack.pop_back();
-    InFunctionDepth--;
-    lineIndex = savedLine;
-    hasErrored = savedError || hasErrored;
-    return retVal;
+template <size_t... I>
+constexpr array<UnaryKernel, sizeof...(I)> makeUnaryKernels(index_sequence<I...>) {
+    return {{ unaryKernel<ValueType(I / OPR_COUNT), Operator(I % OPR_COUNT)>... }};
 }
 
-bool truthy(const ROSdatatype& v) {
-    if (v.type == "bool") return v.boolValue;
-    if (v.type == "float") return v.floatValue != 0.0f;
-    if (v.type == "string") return !v.stringValue.empty();
-    if (v.type == "list") return !v.listValue.empty();
-    return false;
+// flattened [operand type][operator]
+constexpr auto unaryKernels = makeUnaryKernels(make_index_sequence<valueTypeCount * OPR_COUNT>());
+
+inline ROSdatatype unaryMath(const ROSdatatype& Adata, Operator op) {
+    return unaryKernels[Adata.type() * OPR_COUNT + op](Adata);
 }
 
-void execBlock(const vector<string>& block) {
-    int savedLineIndex = lineIndex;
-    lineIndex = 0;
-    while (lineIndex < (int)block.size()) {
-        string line = block[lineIndex];
-        vector<string> tokens = tokenize(line);
-        if (tokens.empty()) { lineIndex++; continue; }
-        string cmd = tokens[0];
-        
-        if (cmd == "var") {
-            if (tokens.size() < 4 || tokens[2] != "=") { error("invalid var syntax"); lineIndex++; continue; }
-            size_t eqpos = line.find('=');
-            if (eqpos == string::npos) { error("missing = in var"); lineIndex++; continue; }
-            string name = tokens[1];
-            string exprStr = strip(sliceStr(line, eqpos + 1));
-            ROSdatatype val = expression(exprStr);
+// recursive descent over operatorTable levels: level 0 binds tightest
+struct ExprParser {
+    vector<Token> tokens;
+    string source;
+    size_t pos = 0;
+    string err;
 
-            if (InFunctionDepth > 0 && !GlobalMarkStack.empty() && GlobalMarkStack.back().count(name)) {
-                variables[name] = val;
-            } else {
-                currentScope()[name] = val;
-            }
-        }
-        else if (cmd == "global") {
-            if (InFunctionDepth == 0) { lineIndex++; continue; }
-            if (tokens.size() < 2) { error("global requires a name"); lineIndex++; continue; }
-            GlobalMarkStack.back().insert(tokens[1]);
-        }
-        else if (cmd == "def") {
-            if (tokens.size() < 2) { error("function name missing"); lineIndex++; continue; }
-            string fname = tokens[1];
-            size_t lp = line.find("("), rp = line.find(")");
-            vector<string> params;
-            if (lp != string::npos && rp != string::npos && rp > lp) {
-                string inside = sliceStr(line, lp + 1, rp);
-                string cur;
-                for (char c : inside) { if (c == ',') { params.push_back(strip(cur)); cur.clear(); } else cur += c; }
-                if (!cur.empty()) params.push_back(strip(cur));
-            }
-            vector<string> fb;
-            int depth = 1;
-            lineIndex++;
-            while (lineIndex < (int)block.size() && depth > 0) {
-                vector<string> t = tokenize(block[lineIndex]);
-                if (!t.empty()) {
-                    if (t[0] == "def") depth++;
-                    else if (t[0] == "end") depth--;
-                }
-                if (depth > 0) fb.push_back(block[lineIndex]);
-                lineIndex++;
+    bool atEnd() const { return pos >= tokens.size(); }
+    string text(const Token& tok) const { return source.substr(tok.begin, tok.end - tok.begin); }
+
+    ExprPtr fail(const string& msg) {
+        if (err.empty()) err = msg;
+        return nullptr;
+    }
+
+    // the next token if it is an operator of this level
+    const OperatorInfo* peekOperator(int level) const {
+        if (atEnd() || tokens[pos].kind != TOK_OPERATOR || operatorTable[tokens[pos].op].level != level) return nullptr;
+        return &operatorTable[tokens[pos].op];
+    }
+
+    ExprPtr parseLevel(int level) {
+        if (level < 0) return parsePrimary();
+
+        const OperatorInfo* info = peekOperator(level);
+        if (info && info->form == FORM_PREFIX) {
+            Operator op = tokens[pos++].op;
+            if (atEnd()) return fail(string("Missing operand for ") + info->text);
+            ExprPtr operand = parseLevel(level);
+            if (!operand) return nullptr;
+            ExprPtr node(new ExprNode());
+            node->kind = ExprNode::Unary;
+            node->text = info->text;
+            node->op = op;
+            node->args.push_back(move(operand));
+            return node;
+        }
+
+        ExprPtr left = parseLevel(level - 1);
+        if (!left) return nullptr;
+        while ((info = peekOperator(level)) && info->form != FORM_PREFIX) {
+            pos++;
+            ExprPtr node(new ExprNode());
+            node->text = info->text;
+            node->op = tokens[pos - 1].op;
+            node->args.push_back(move(left));
+            if (info->form == FORM_SUFFIX) {
+                node->kind = ExprNode::Unary;
+            } else {
+                if (atEnd()) return fail(string("Missing operand for ") + info->text);
+                ExprPtr right = parseLevel(level - 1);
+                if (!right) return nullptr;
+                node->kind = ExprNode::Binary;
+                node->args.push_back(move(right));
             }
+            left = move(node);
+        }
+        return left;
+    }
 
-            functionData func;
-            func.argNames = params;
-            func.numArgs = (int)params.size();
-            func.body = fb;
+    ExprPtr parseTop() { return parseLevel(precedenceLevels - 1); }
 
-            functions[fname] = func;
-            continue;
+    ExprPtr parsePrimary() {
+        if (atEnd()) return fail("Missing operand");
+        const Token& tok = tokens[pos++];
+
+        switch (tok.kind) {
+            case TOK_LPAREN: {
+                ExprPtr inner = parseTop();
+                if (!inner) return nullptr;
+                if (atEnd() || tokens[pos].kind != TOK_RPAREN) return fail("Unmatched parenthesis");
+                pos++;
+                return inner;
+            }
+            case TOK_RPAREN: case TOK_COMMA: return fail("Unexpected '" + text(tok) + "'");
+            case TOK_OPERATOR: return fail("Missing operand for " + text(tok));
+            case TOK_ERROR: return fail("Unterminated string " + text(tok));
+            default: break;
         }
-        else if (functions.count(cmd)) {
-            // standalone function call (no assignment)
+
+        ExprPtr node(new ExprNode());
+        if (tok.kind != TOK_NAME) {
+            node->kind = ExprNode::Literal;
+            node->constant = tok.constant;
+            return node;
+        }
+        node->text = text(tok);
+        node->symbol = tok.symbol;
+        if (!atEnd() && tokens[pos].kind == TOK_LPAREN) {
             // enforce mandatory space before '('
-            if (line.find(cmd + "(") != string::npos) {
-                error("function calls require a space before '('");
-                return;
+            if (tokens[pos].begin == tok.end) return fail("function calls require a space before '('");
+            pos++;
+            node->kind = ExprNode::Call;
+            if (!atEnd() && tokens[pos].kind == TOK_RPAREN) { pos++; return node; }
+            while (true) {
+                ExprPtr arg = parseTop();
+                if (!arg) return nullptr;
+                node->args.push_back(move(arg));
+                if (atEnd()) return fail("Unmatched parenthesis");
+                const Token& sep = tokens[pos++];
+                if (sep.kind == TOK_RPAREN) break;
+                if (sep.kind != TOK_COMMA) return fail("Unexpected '" + text(sep) + "' in call to " + node->text);
             }
-            size_t lp = line.find("("), rp = line.find(")");
-            vector<string> args;
-            if (lp != string::npos && rp != string::npos && rp > lp) {
-                string inside = sliceStr(line, lp + 1, rp);
-                string cur;
-                int depth = 0;
-                for (char c : inside) {
-                    if (c == '(') depth++; else if (c == ')') depth--;
-                    if (c == ',' && depth == 0) { args.push_back(strip(cur)); cur.clear(); }
-                    else cur += c;
+            return node;
+        }
+        node->kind = ExprNode::Variable;
+        return node;
+    }
+};
+
+// parse errors become an Invalid node so they are reported when (and where) the expression runs
+ExprPtr parseExpression(const string& expr) {
+    ExprParser parser;
+    parser.tokens = tokenizeExpression(expr);
+    parser.source = expr;
+    ExprPtr root;
+    if (parser.tokens.empty()) parser.err = "Empty expression";
+    else {
+        root = parser.parseTop();
+        if (root && !parser.atEnd()) { root.reset(); parser.fail("Unexpected '" + parser.text(parser.tokens[parser.pos]) + "'"); }
+    }
+    if (!root) {
+        root.reset(new ExprNode());
+        root->kind = ExprNode::Invalid;
+        root->text = parser.err;
+    }
+    return root;
+}
+
+// builtins only: ROS functions are entered with pushFrame; missing arguments default to 0
+ROSdatatype callFunction(const functionData& func, vector<ROSdatatype> args) {
+    int numArgs = func.numArgs < 0 ? (int)args.size() : func.numArgs;
+    args.resize(min(numArgs, (int)args.size()));
+    while ((int)args.size() < numArgs) {
+        args.push_back(makeReal(0));
+    }
+    return func.cfunc(args);
+}
+
+void enterFrame(Frame f) {
+    f.slotBase = frameSlots.size();
+    f.taskBase = evalTasks.size();
+    f.savedError = hasErrored;
+    f.savedLine = lineIndex;
+    localBase = f.slotBase;
+    frames.push_back(f);
+}
+
+// call a ROS function with its argc arguments on top of valueStack
+void pushFrame(const functionData& func, int argc) {
+    Frame f;
+    f.function = &func;
+    f.valueBase = valueStack.size() - argc;
+    f.program = func.program;
+    f.pc = func.bodyBegin;
+    f.end = func.bodyEnd;
+    f.chunk = func.chunk;
+    enterFrame(f);
+    frameSlots.resize(localBase + func.numSlots);
+    for (int i = 0; i < func.numArgs; i++) {
+        if (i < argc) frameSlots[localBase + i] = move(valueStack[f.valueBase + i]);
+        else frameSlots[localBase + i] = makeReal(0);
+    }
+    valueStack.resize(f.valueBase);
+    hasErrored = false;
+}
+
+// drop the running frame and everything it left behind; the caller pushes the return value
+void popFrame() {
+    const Frame& f = frames.back();
+    valueStack.resize(f.valueBase);
+    evalTasks.resize(f.taskBase);
+    frameSlots.resize(f.slotBase);
+    hasErrored = f.savedError || hasErrored;
+    lineIndex = f.savedLine;
+    frames.pop_back();
+    localBase = frames.empty() ? 0 : frames.back().slotBase;
+}
+
+void pushCompiledExpr(const ExprNode& node);
+bool osrLoop(const vector<Statement>& block, int header);
+
+// advance the innermost pending expression by one step; a call to a ROS function pushes a frame
+// and its return value lands on valueStack in place of the call node
+void stepTask() {
+    EvalTask& task = evalTasks.back();
+    const ExprNode& node = *task.node;
+    if (node.callFree) {
+        evalTasks.pop_back();
+        pushCompiledExpr(node);
+        return;
+    }
+    switch (node.kind) {
+        case ExprNode::Unary:
+            if (task.next == 0) { task.next = 1; evalTasks.push_back({ node.args[0].get(), 0 }); break; }
+            valueStack.back() = unaryMath(valueStack.back(), node.op);
+            evalTasks.pop_back();
+            break;
+        case ExprNode::Binary: {
+            if (task.next < 2) { const ExprNode* arg = node.args[task.next++].get(); evalTasks.push_back({ arg, 0 }); break; }
+            ROSdatatype b = move(valueStack.back());
+            valueStack.pop_back();
+            valueStack.back() = binaryMath(valueStack.back(), node.op, b);
+            evalTasks.pop_back();
+            break;
+        }
+        case ExprNode::Call: {
+            // arguments first, then the target, as in the vm
+            if (task.next < node.args.size()) { const ExprNode* arg = node.args[task.next++].get(); evalTasks.push_back({ arg, 0 }); break; }
+            int argc = (int)node.args.size();
+            evalTasks.pop_back();
+            functionData* target = resolveCall(node.call, node.symbol);
+            if (!target) {
+                error("unknown function: " + node.text);
+                valueStack.resize(valueStack.size() - argc);
+                valueStack.emplace_back();
+                break;
+            }
+            if (target->isC) {
+                vector<ROSdatatype> args(make_move_iterator(valueStack.end() - argc), make_move_iterator(valueStack.end()));
+                valueStack.resize(valueStack.size() - argc);
+                valueStack.push_back(callFunction(*target, move(args)));
+            }
+            else pushFrame(*target, argc);
+            break;
+        }
+        default:
+            error(node.text);
+            valueStack.emplace_back();
+            evalTasks.pop_back();
+            break;
+    }
+}
+
+// compiled programs leave out the engine line; they have no engines to switch
+void printHelp(bool interpreter = true) {
+    print("ROS++ interpreter");
+    print("Commands: print, var, def, return, while, for, global, end");
+    print("var <name> = <expression>");
+    print("var x = add (10, 2) + 32 / 3  * (54 + 2)");
+    print("");
+    print("def <name> (arg1, arg2 ...)");
+    print("return <expression>");
+    print("end");
+    print("");
+    print("def add (a, b)");
+    print("return a + b");
+    print("end");
+    print("");
+    print("while (<expression>)");
+    print("end");
+    print("while (true)");
+    print("print 'yes'");
+    print("end");
+    print("");
+    print("for (<var> = <expression>; <expression>; <expression>)");
+    print("end");
+    print("for (i = 0; i != 10; i + 1)");
+    print("print i");
+    print("end");
+    if (!interpreter) return;
+    print("");
+    print("engine <walker|vm|reg|jit|trace>  (at the prompt, or --engine=<name> on the command line)");
+}
+
+// run statements [begin, end) of a program produced by compileProgram; calls and loops are
+// driven by frames and evalTasks instead of C++ recursion; loops jump by the indices linked at load time
+const unsigned osrThreshold = 500; // back edges before a top-level loop is replaced on the stack
+bool osrEnabled = true; // off with --no-osr
+
+void execBlock(const vector<Statement>& block, int begin, int end) {
+    size_t depth = frames.size();
+    Frame top;
+    top.valueBase = valueStack.size();
+    top.program = &block;
+    top.pc = begin;
+    top.end = end;
+    enterFrame(top);
+
+    // start evaluating expr and move to nextPhase; true when its value is already on valueStack
+    auto evaluate = [](Frame& f, const ExprNode& expr, int nextPhase) {
+        f.phase = nextPhase;
+        if (expr.callFree) { pushCompiledExpr(expr); return true; }
+        evalTasks.push_back({ &expr, 0 });
+        return false;
+    };
+    auto popValue = []() {
+        ROSdatatype val = move(valueStack.back());
+        valueStack.pop_back();
+        return val;
+    };
+    auto next = [](Frame& f, int pc) { f.pc = pc; f.phase = 0; };
+
+    while (true) {
+        if (evalTasks.size() > frames.back().taskBase) { stepTask(); continue; }
+        Frame& f = frames.back();
+        // leaving a frame: a return, the end of a function body, or the end of the program
+        auto leave = [&](ROSdatatype retVal) {
+            bool last = frames.size() == depth + 1;
+            popFrame();
+            if (!last) valueStack.push_back(move(retVal));
+            return last;
+        };
+        if (f.pc >= f.end) { if (leave(makeReal(0))) return; continue; }
+
+        const Statement& st = (*f.program)[f.pc];
+        lineIndex = f.pc;
+
+        switch (st.kind) {
+            case STMT_EMPTY:
+                break;
+            case STMT_END: {
+                // back to the loop header, unless an error in the body ends the loop
+                StmtKind header = st.parent < 0 ? STMT_END : (*f.program)[st.parent].kind;
+                if ((header != STMT_WHILE && header != STMT_FOR) || hasErrored) break;
+                // a hot top-level loop finishes in compiled code, picking up from this back edge
+                if (osrEnabled && !f.function && ++(*f.program)[st.parent].backEdges >= osrThreshold) {
+                    if (osrLoop(*f.program, st.parent) && leave(makeReal(0))) return; // the loop hit a top-level return
+                    // the compiled run pushed frames, so f may have moved
+                    next(frames.back(), frames.back().pc + 1);
+                    continue;
                 }
-                if (!cur.empty()) args.push_back(strip(cur));
+                f.pc = st.parent;
+                f.phase = header == STMT_FOR ? 3 : 0;
+                continue;
             }
+            case STMT_VAR:
+                if (st.names.empty()) { error("invalid var syntax"); break; }
+                if (f.phase == 0 && !evaluate(f, *st.exprs[0], 1)) continue;
+                varSlot(st.targets[0]) = popValue();
+                break;
+            case STMT_GLOBAL:
+                // resolved at load time by resolveProgram
+                if (st.tokens.size() < 2) error("global requires a name");
+                break;
+            case STMT_DEF:
+                if (st.tokens.size() < 2) error("function name missing");
+                else defineFunction(st.symbol, st.function);
+                next(f, st.endIndex + 1);
+                continue;
+            case STMT_RETURN:
+                if (f.phase == 0 && !evaluate(f, *st.exprs[0], 1)) continue;
+                if (leave(popValue())) return;
+                continue;
+            case STMT_WHILE:
+                if (st.exprs.empty()) { error("invalid while syntax"); next(f, st.endIndex + 1); continue; }
+                if (f.phase == 0 && !evaluate(f, *st.exprs[0], 1)) continue;
+                next(f, truthy(popValue()) ? f.pc + 1 : st.endIndex + 1);
+                continue;
+            case STMT_FOR:
+                if (st.exprs.size() != 3) { error("for requires 3 parts"); next(f, st.endIndex + 1); continue; }
+                // phases: 0 init, 1 store init, 2 test cond, 3 increment (from "end"), 4 store increment
+                if (f.phase == 0 && !evaluate(f, *st.exprs[0], 1)) continue;
+                if (f.phase == 3 && !evaluate(f, *st.exprs[2], 4)) continue;
+                if (f.phase == 1 || f.phase == 4) {
+                    const VarRef& target = st.targets[f.phase == 1 ? 0 : 1];
+                    ROSdatatype val = popValue();
+                    if (target.slot >= 0) varSlot(target) = move(val);
+                    if (!evaluate(f, *st.exprs[1], 2)) continue;
+                }
+                next(f, truthy(popValue()) ? f.pc + 1 : st.endIndex + 1);
+                continue;
+            case STMT_HELP:
+                printHelp();
+                break;
+            case STMT_CALL:
+                // standalone function call (no assignment); the handle is cached on the call node
+                if (!resolveCall(st.exprs[0]->call, st.symbol)) break;
+                // enforce mandatory space before '('; the error abandons the innermost block
+                if (st.callMissingSpace) {
+                    error("function calls require a space before '('");
+                    if (st.parent >= 0 && (*f.program)[st.parent].kind != STMT_DEF) { next(f, (*f.program)[st.parent].endIndex); continue; }
+                    if (leave(makeReal(0))) return;
+                    continue;
+                }
+                if (f.phase == 0 && !evaluate(f, *st.exprs[0], 1)) continue;
+                valueStack.pop_back();
+                break;
+        }
+        next(f, f.pc + 1);
+    }
+}
 
-            (void)callFunction(cmd, args);
-            lineIndex++;
-            continue;
+// ---- bytecode compiler and stack VM (engine "vm") ----
+
+enum class Engine { Walker, StackVM, RegisterVM, BaselineJIT, TracingJIT };
+Engine engine = Engine::Walker; // "--engine=vm" on the command line or "engine vm" at the prompt
+
+bool selectEngine(const string& name) {
+    if (name == "walker") engine = Engine::Walker;
+    else if (name == "vm") engine = Engine::StackVM;
+    else if (name == "reg") engine = Engine::RegisterVM;
+    else if (name == "jit") engine = Engine::BaselineJIT;
+    else if (name == "trace") engine = Engine::TracingJIT;
+    else return false;
+    return true;
+}
+
+int addName(Chunk& chunk, const string& name) {
+    for (size_t i = 0; i < chunk.names.size(); i++) if (chunk.names[i] == name) return (int)i;
+    chunk.names.push_back(name);
+    return (int)chunk.names.size() - 1;
+}
+
+int emit(Chunk& chunk, OpCode op, int a = 0, int b = 0) {
+    Instr in;
+    in.op = op; in.a = a; in.b = b; in.line = lineIndex;
+    chunk.code.push_back(in);
+    return (int)chunk.code.size() - 1;
+}
+
+void emitCall(Chunk& chunk, int symbol, int argc) {
+    int call = emit(chunk, OP_CALL, symbol, argc);
+    chunk.code[call].c = (int)chunk.callSites.size();
+    chunk.callSites.emplace_back();
+}
+
+void compileExpr(Chunk& chunk, const ExprNode& node) {
+    switch (node.kind) {
+        case ExprNode::Literal:
+            emit(chunk, OP_CONST, node.constant);
+            break;
+        case ExprNode::Variable:
+            emit(chunk, node.var.local ? OP_LOAD_LOCAL : OP_LOAD_GLOBAL, node.var.slot, node.symbol);
+            break;
+        case ExprNode::Unary:
+            compileExpr(chunk, *node.args[0]);
+            emit(chunk, OP_UNARY, node.op);
+            break;
+        case ExprNode::Binary:
+            compileExpr(chunk, *node.args[0]);
+            compileExpr(chunk, *node.args[1]);
+            emit(chunk, OP_BINARY, node.op);
+            break;
+        case ExprNode::Call:
+            for (const auto& arg : node.args) compileExpr(chunk, *arg);
+            emitCall(chunk, node.symbol, (int)node.args.size());
+            break;
+        default:
+            emit(chunk, OP_ERROR, addName(chunk, node.text));
+            break;
+    }
+}
+
+Chunk* compileChunk(const vector<Statement>& block, int begin, int end, bool isFunction);
+void fuseSuperinstructions(Chunk& chunk);
+
+// lower statements [begin, end) into chunk; loops become conditional/backward jumps. exits collects
+// forward jumps out of the body of the loop being compiled, patched to its back edge
+void compileRange(Chunk& chunk, const vector<Statement>& block, int begin, int end, vector<int>* exits = nullptr) {
+    int savedLineIndex = lineIndex;
+    for (lineIndex = begin; lineIndex < end; lineIndex++) {
+        const Statement& st = block[lineIndex];
+        if (st.kind == STMT_EMPTY) continue;
+
+        if (st.kind == STMT_VAR) {
+            if (st.names.empty()) { emit(chunk, OP_ERROR, addName(chunk, "invalid var syntax")); emit(chunk, OP_POP); continue; }
+            compileExpr(chunk, *st.exprs[0]);
+            emit(chunk, st.targets[0].local ? OP_STORE_LOCAL : OP_STORE_GLOBAL, st.targets[0].slot);
         }
-        else if (cmd == "return") {
-            string exprStr = sliceStr(line, line.find("return") + 6);
-            ReturnValueStack.push_back(expression(strip(exprStr)));
-            if (!ReturnFlagStack.empty()) ReturnFlagStack.back() = true;
-            return;
+        else if (st.kind == STMT_GLOBAL) {
+            // resolved at load time by resolveProgram
+            if (st.tokens.size() < 2) { emit(chunk, OP_ERROR, addName(chunk, "global requires a name")); emit(chunk, OP_POP); continue; }
         }
-        else if (cmd == "while") {
-            size_t lp = line.find("("), rp = line.find_last_of(')');
-            if (lp == string::npos || rp == string::npos || rp <= lp) { error("invalid while syntax"); lineIndex++; continue; }
-            string condExpr = strip(sliceStr(line, lp + 1, rp));
-
-            vector<string> body;
-            int depth = 1;
-            lineIndex++;
-            while (lineIndex < (int)block.size() && depth > 0) {
-                vector<string> t = tokenize(block[lineIndex]);
-                if (!t.empty()) {
-                    if (t[0] == "while") depth++;
-                    else if (t[0] == "end") depth--;
+        else if (st.kind == STMT_DEF) {
+            if (st.tokens.size() < 2) { emit(chunk, OP_ERROR, addName(chunk, "function name missing")); emit(chunk, OP_POP); }
+            else {
+                if (!st.function->chunk) st.function->chunk = compileChunk(block, lineIndex + 1, st.endIndex, true);
+                chunk.protos.push_back(st.function);
+                emit(chunk, OP_DEF, st.symbol, (int)chunk.protos.size() - 1);
+            }
+            lineIndex = st.endIndex;
+        }
+        else if (st.kind == STMT_RETURN) {
+            compileExpr(chunk, *st.exprs[0]);
+            emit(chunk, OP_RETURN);
+        }
+        else if (st.kind == STMT_WHILE) {
+            int header = lineIndex;
+            if (st.exprs.empty()) { emit(chunk, OP_ERROR, addName(chunk, "invalid while syntax")); emit(chunk, OP_POP); lineIndex = st.endIndex; continue; }
+            int top = (int)chunk.code.size();
+            compileExpr(chunk, *st.exprs[0]);
+            int exitJump = emit(chunk, OP_JUMP_IF_FALSE);
+            vector<int> bodyExits;
+            compileRange(chunk, block, header + 1, st.endIndex, &bodyExits);
+            lineIndex = header;
+            int back = emit(chunk, OP_LOOP, top);
+            for (int jump : bodyExits) chunk.code[jump].a = chunk.code[jump].b = back;
+            chunk.code[exitJump].a = chunk.code[back].b = (int)chunk.code.size();
+            lineIndex = st.endIndex;
+        }
+        else if (st.kind == STMT_FOR) {
+            int header = lineIndex;
+            if (st.exprs.size() != 3) { emit(chunk, OP_ERROR, addName(chunk, "for requires 3 parts")); emit(chunk, OP_POP); lineIndex = st.endIndex; continue; }
+            auto compileAssign = [&](const VarRef& target, const ExprNode& expr) {
+                compileExpr(chunk, expr);
+                if (target.slot < 0) emit(chunk, OP_POP);
+                else emit(chunk, target.local ? OP_STORE_LOCAL : OP_STORE_GLOBAL, target.slot);
+            };
+            compileAssign(st.targets[0], *st.exprs[0]);
+            int top = (int)chunk.code.size();
+            compileExpr(chunk, *st.exprs[1]);
+            int exitJump = emit(chunk, OP_JUMP_IF_FALSE);
+            vector<int> bodyExits;
+            compileRange(chunk, block, header + 1, st.endIndex, &bodyExits);
+            lineIndex = header;
+            // errors inside the body skip the increment, as in execBlock
+            int errorCheck = emit(chunk, OP_LOOP, (int)chunk.code.size() + 1);
+            for (int jump : bodyExits) chunk.code[jump].a = chunk.code[jump].b = errorCheck;
+            compileAssign(st.targets[1], *st.exprs[2]);
+            // an error in the increment still tests the condition once more, as in execBlock
+            emit(chunk, OP_LOOP, top, top);
+            chunk.code[exitJump].a = chunk.code[errorCheck].b = (int)chunk.code.size();
+            lineIndex = st.endIndex;
+        }
+        else if (st.kind == STMT_HELP) {
+            emit(chunk, OP_HELP);
+        }
+        else if (st.kind == STMT_CALL) {
+            // standalone function call; lines naming no function are skipped like in execBlock
+            int check = emit(chunk, OP_CHECK_FUNC, st.symbol);
+            if (st.callMissingSpace) {
+                // the error abandons the innermost block: on to the loop's end, or out of the function
+                emit(chunk, OP_ERROR, addName(chunk, "function calls require a space before '('"));
+                emit(chunk, OP_POP);
+                if (st.parent >= 0 && block[st.parent].kind != STMT_DEF) exits->push_back(emit(chunk, OP_LOOP));
+                else {
+                    emit(chunk, OP_CONST, internConstant(makeReal(0)));
+                    emit(chunk, OP_RETURN);
                 }
-                if (depth > 0) body.push_back(block[lineIndex]);
-                lineIndex++;
+            } else {
+                compileExpr(chunk, *st.exprs[0]);
+                emit(chunk, OP_POP);
             }
+            chunk.code[check].b = (int)chunk.code.size();
+        }
+    }
+    lineIndex = savedLineIndex;
+}
 
-            while (true) {
-                ROSdatatype cv = expression(condExpr);
-                if (!truthy(cast(cv, "bool"))) break;
-                execBlock(body);
-                if (hasErrored) break;
+vector<unique_ptr<Chunk>> loadedChunks; // kept alive like loadedPrograms
+
+Chunk* compileChunk(const vector<Statement>& block, int begin, int end, bool isFunction) {
+    loadedChunks.push_back(unique_ptr<Chunk>(new Chunk()));
+    Chunk* chunk = loadedChunks.back().get();
+    compileRange(*chunk, block, begin, end);
+    if (isFunction) {
+        emit(*chunk, OP_CONST, internConstant(makeReal(0)));
+        emit(*chunk, OP_RETURN);
+    } else {
+        emit(*chunk, OP_HALT);
+    }
+    fuseSuperinstructions(*chunk);
+    return chunk;
+}
+
+// ---- quickening: OP_BINARY specializes itself once its operands have shared one numeric type a few times ----
+
+const int quickenThreshold = 2;
+
+OpCode floatForm(Operator op) {
+    switch (op) {
+        case OPR_ADD: return OP_ADD_FF;
+        case OPR_SUB: return OP_SUB_FF;
+        case OPR_MUL: return OP_MUL_FF;
+        case OPR_LT: return OP_LT_FF;
+        case OPR_LE: return OP_LE_FF;
+        case OPR_GT: return OP_GT_FF;
+        case OPR_GE: return OP_GE_FF;
+        case OPR_EQ: return OP_EQ_FF;
+        case OPR_NE: return OP_NE_FF;
+        default: return OP_BINARY;
+    }
+}
+
+// the quickened form for two operands of a numeric type
+OpCode numberForm(Operator op, ValueType type) {
+    OpCode form = floatForm(op);
+    if (form == OP_BINARY || type == TYPE_FLOAT) return form;
+    return OpCode(form - OP_ADD_FF + (type == TYPE_INT ? OP_ADD_II : OP_ADD_DD));
+}
+
+void execBinary(Instr& in) {
+    ROSdatatype& a = valueStack[valueStack.size() - 2];
+    const ROSdatatype& b = valueStack.back();
+    if (a.type() == b.type() && isNumeric(a.type()) && ++in.c >= quickenThreshold) in.op = numberForm((Operator)in.a, a.type());
+    ROSdatatype result = binaryMath(a, (Operator)in.a, b);
+    valueStack.pop_back();
+    valueStack.back() = move(result);
+}
+
+template <typename Num, Operator op>
+inline void execRealBinary(Instr& in) {
+    ROSdatatype& a = valueStack[valueStack.size() - 2];
+    const ROSdatatype& b = valueStack.back();
+    if (a.type() != realKind<Num> || b.type() != realKind<Num>) {
+        // guard failed: deoptimize and start counting again
+        in.op = OP_BINARY;
+        in.c = 0;
+        execBinary(in);
+        return;
+    }
+    Num x = realOf<Num>(a), y = realOf<Num>(b);
+    if constexpr (op == OPR_ADD) setReal(a, x + y);
+    else if constexpr (op == OPR_SUB) setReal(a, x - y);
+    else if constexpr (op == OPR_MUL) setReal(a, x * y);
+    else if constexpr (op == OPR_LT) a = makeBool(x < y);
+    else if constexpr (op == OPR_LE) a = makeBool(x <= y);
+    else if constexpr (op == OPR_GT) a = makeBool(x > y);
+    else if constexpr (op == OPR_GE) a = makeBool(x >= y);
+    else if constexpr (op == OPR_EQ) a = makeBool(x == y);
+    else if constexpr (op == OPR_NE) a = makeBool(x != y);
+    valueStack.pop_back();
+}
+
+template <Operator op>
+inline void execIntBinary(Instr& in) {
+    ROSdatatype& a = valueStack[valueStack.size() - 2];
+    const ROSdatatype& b = valueStack.back();
+    if (a.type() != TYPE_INT || b.type() != TYPE_INT) {
+        in.op = OP_BINARY;
+        in.c = 0;
+        execBinary(in);
+        return;
+    }
+    int64_t x = a.intValue(), y = b.intValue();
+    if constexpr (op == OPR_ADD) a.setInt((int64_t)((uint64_t)x + (uint64_t)y));
+    else if constexpr (op == OPR_SUB) a.setInt((int64_t)((uint64_t)x - (uint64_t)y));
+    else if constexpr (op == OPR_MUL) a.setInt((int64_t)((uint64_t)x * (uint64_t)y));
+    else if constexpr (op == OPR_LT) a = makeBool(x < y);
+    else if constexpr (op == OPR_LE) a = makeBool(x <= y);
+    else if constexpr (op == OPR_GT) a = makeBool(x > y);
+    else if constexpr (op == OPR_GE) a = makeBool(x >= y);
+    else if constexpr (op == OPR_EQ) a = makeBool(x == y);
+    else if constexpr (op == OPR_NE) a = makeBool(x != y);
+    valueStack.pop_back();
+}
+
+// walker side: each call-free expression gets its own op list, so it quickens like vm code
+void pushCompiledExpr(const ExprNode& node) {
+    if (!node.code) {
+        loadedChunks.push_back(unique_ptr<Chunk>(new Chunk()));
+        node.code = loadedChunks.back().get();
+        compileExpr(*node.code, node);
+        emit(*node.code, OP_HALT);
+    }
+    const Chunk& chunk = *node.code;
+    for (Instr* in = chunk.code.data(); ; in++) {
+        switch (in->op) {
+            case OP_CONST:
+                valueStack.push_back(constantPool[in->a]);
+                break;
+            case OP_LOAD_LOCAL:
+                valueStack.push_back(frameSlots[localBase + in->a]);
+                if (valueStack.back().type() == TYPE_NONE) valueStack.back() = unsetLocal(in->b);
+                break;
+            case OP_LOAD_GLOBAL:
+                valueStack.push_back(variables[in->a]);
+                if (valueStack.back().type() == TYPE_NONE) error("cannot parse value: " + symbolNames[in->b]);
+                break;
+            case OP_UNARY:
+                valueStack.back() = unaryMath(valueStack.back(), (Operator)in->a);
+                break;
+            case OP_BINARY: execBinary(*in); break;
+            case OP_ADD_FF: execRealBinary<float, OPR_ADD>(*in); break;
+            case OP_SUB_FF: execRealBinary<float, OPR_SUB>(*in); break;
+            case OP_MUL_FF: execRealBinary<float, OPR_MUL>(*in); break;
+            case OP_LT_FF: execRealBinary<float, OPR_LT>(*in); break;
+            case OP_LE_FF: execRealBinary<float, OPR_LE>(*in); break;
+            case OP_GT_FF: execRealBinary<float, OPR_GT>(*in); break;
+            case OP_GE_FF: execRealBinary<float, OPR_GE>(*in); break;
+            case OP_EQ_FF: execRealBinary<float, OPR_EQ>(*in); break;
+            case OP_NE_FF: execRealBinary<float, OPR_NE>(*in); break;
+            case OP_ADD_II: execIntBinary<OPR_ADD>(*in); break;
+            case OP_SUB_II: execIntBinary<OPR_SUB>(*in); break;
+            case OP_MUL_II: execIntBinary<OPR_MUL>(*in); break;
+            case OP_LT_II: execIntBinary<OPR_LT>(*in); break;
+            case OP_LE_II: execIntBinary<OPR_LE>(*in); break;
+            case OP_GT_II: execIntBinary<OPR_GT>(*in); break;
+            case OP_GE_II: execIntBinary<OPR_GE>(*in); break;
+            case OP_EQ_II: execIntBinary<OPR_EQ>(*in); break;
+            case OP_NE_II: execIntBinary<OPR_NE>(*in); break;
+            case OP_ADD_DD: execRealBinary<double, OPR_ADD>(*in); break;
+            case OP_SUB_DD: execRealBinary<double, OPR_SUB>(*in); break;
+            case OP_MUL_DD: execRealBinary<double, OPR_MUL>(*in); break;
+            case OP_LT_DD: execRealBinary<double, OPR_LT>(*in); break;
+            case OP_LE_DD: execRealBinary<double, OPR_LE>(*in); break;
+            case OP_GT_DD: execRealBinary<double, OPR_GT>(*in); break;
+            case OP_GE_DD: execRealBinary<double, OPR_GE>(*in); break;
+            case OP_EQ_DD: execRealBinary<double, OPR_EQ>(*in); break;
+            case OP_NE_DD: execRealBinary<double, OPR_NE>(*in); break;
+            case OP_ERROR:
+                error(chunk.names[in->a]);
+                valueStack.emplace_back();
+                break;
+            default: // OP_HALT; call-free expressions compile to nothing else
+                return;
+        }
+    }
+}
+
+// ---- superinstructions: frequent load/const/op sequences fused into their first instruction ----
+// The fused op keeps the LOAD's operands and reads the CONST, operator and jump/store that still
+// follow it, so jump targets never move; unless the variable and constant are both of one numeric type it
+// runs as the plain load.
+
+template <typename T>
+ROS_INLINE bool compareNumbers(Operator op, T x, T y) {
+    switch (op) {
+        case OPR_LT: return x < y;
+        case OPR_LE: return x <= y;
+        case OPR_GT: return x > y;
+        case OPR_GE: return x >= y;
+        case OPR_EQ: return x == y;
+        default: return x != y;
+    }
+}
+
+// LOAD x; CONST k; compare; JUMP_IF_FALSE  ("while (counter != 0)"); ip points at the CONST
+ROS_INLINE bool fusedCompareBranch(const ROSdatatype& x, const Instr* code, size_t& ip) {
+    const ROSdatatype& k = constantPool[code[ip].a];
+    Operator op = (Operator)code[ip + 1].a;
+    bool cond;
+    if (x.type() == TYPE_FLOAT && k.type() == TYPE_FLOAT) cond = compareNumbers(op, x.floatValue(), k.floatValue());
+    else if (x.type() == TYPE_INT && k.type() == TYPE_INT) cond = compareNumbers(op, x.intValue(), k.intValue());
+    else if (x.type() == TYPE_DOUBLE && k.type() == TYPE_DOUBLE) cond = compareNumbers(op, x.doubleValue(), k.doubleValue());
+    else return false;
+    ip = cond ? ip + 3 : code[ip + 2].a;
+    return true;
+}
+
+// LOAD x; CONST k; ADD or SUB; STORE x  ("i + 1" in a for header, "var n = n - 1")
+ROS_INLINE bool fusedAddStore(ROSdatatype& x, const Instr* code, size_t& ip) {
+    const ROSdatatype& k = constantPool[code[ip].a];
+    bool add = code[ip + 1].a == OPR_ADD;
+    if (x.type() == TYPE_FLOAT && k.type() == TYPE_FLOAT) x.setFloat(add ? x.floatValue() + k.floatValue() : x.floatValue() - k.floatValue());
+    else if (x.type() == TYPE_INT && k.type() == TYPE_INT) x.setInt((int64_t)(add ? (uint64_t)x.intValue() + (uint64_t)k.intValue() : (uint64_t)x.intValue() - (uint64_t)k.intValue()));
+    else if (x.type() == TYPE_DOUBLE && k.type() == TYPE_DOUBLE) x.setDouble(add ? x.doubleValue() + k.doubleValue() : x.doubleValue() - k.doubleValue());
+    else return false;
+    ip += 3;
+    return true;
+}
+
+void fuseSuperinstructions(Chunk& chunk) {
+    vector<Instr>& code = chunk.code;
+    for (size_t i = 0; i + 3 < code.size(); i++) {
+        Instr& load = code[i];
+        if (load.op != OP_LOAD_LOCAL && load.op != OP_LOAD_GLOBAL) continue;
+        bool local = load.op == OP_LOAD_LOCAL;
+        const Instr& k = code[i + 1];
+        const Instr& op = code[i + 2];
+        const Instr& last = code[i + 3];
+        if (k.op != OP_CONST || !isNumeric(constantPool[k.a].type()) || op.op != OP_BINARY) continue;
+        Operator o = (Operator)op.a;
+        if (last.op == OP_JUMP_IF_FALSE && o >= OPR_LT && o <= OPR_NE)
+            load.op = local ? OP_LOCAL_CMP_BRANCH : OP_GLOBAL_CMP_BRANCH;
+        else if (last.op == (local ? OP_STORE_LOCAL : OP_STORE_GLOBAL) && last.a == load.a && (o == OPR_ADD || o == OPR_SUB))
+            load.op = local ? OP_LOCAL_ADD_STORE : OP_GLOBAL_ADD_STORE;
+    }
+}
+
+// GCC and Clang get direct-threaded dispatch through computed goto; other compilers use the switch
+#if defined(__GNUC__)
+#define ROS_THREADED_DISPATCH 1
+#endif
+
+void runChunk(const Chunk& mainChunk) {
+    size_t depth = frames.size();
+    Frame top;
+    top.valueBase = valueStack.size();
+    top.chunk = &mainChunk;
+    enterFrame(top);
+
+    // the running frame's code and ip live in locals; they are written back to the frame around calls
+    const Chunk* chunk = &mainChunk;
+    Instr* code = chunk->code.data();
+    size_t ip = 0;
+    Instr* in;
+
+#ifdef ROS_THREADED_DISPATCH
+    static void* const handlers[] = {
+        &&L_OP_CONST, &&L_OP_LOAD_LOCAL, &&L_OP_LOAD_GLOBAL, &&L_OP_STORE_LOCAL, &&L_OP_STORE_GLOBAL, &&L_OP_POP,
+        &&L_OP_UNARY, &&L_OP_BINARY,
+        &&L_OP_ADD_FF, &&L_OP_SUB_FF, &&L_OP_MUL_FF, &&L_OP_LT_FF, &&L_OP_LE_FF, &&L_OP_GT_FF, &&L_OP_GE_FF, &&L_OP_EQ_FF, &&L_OP_NE_FF,
+        &&L_OP_ADD_II, &&L_OP_SUB_II, &&L_OP_MUL_II, &&L_OP_LT_II, &&L_OP_LE_II, &&L_OP_GT_II, &&L_OP_GE_II, &&L_OP_EQ_II, &&L_OP_NE_II,
+        &&L_OP_ADD_DD, &&L_OP_SUB_DD, &&L_OP_MUL_DD, &&L_OP_LT_DD, &&L_OP_LE_DD, &&L_OP_GT_DD, &&L_OP_GE_DD, &&L_OP_EQ_DD, &&L_OP_NE_DD,
+        &&L_OP_LOCAL_CMP_BRANCH, &&L_OP_GLOBAL_CMP_BRANCH, &&L_OP_LOCAL_ADD_STORE, &&L_OP_GLOBAL_ADD_STORE,
+        &&L_OP_JUMP_IF_FALSE, &&L_OP_LOOP, &&L_OP_CHECK_FUNC, &&L_OP_CALL, &&L_OP_RETURN, &&L_OP_DEF, &&L_OP_HELP, &&L_OP_ERROR, &&L_OP_HALT
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == OP_HALT + 1, "one handler per opcode");
+#define CASE(op) L_##op:
+#define NEXT() do { in = &code[ip++]; lineIndex = in->line; goto *handlers[in->op]; } while (0)
+    NEXT();
+#else
+#define CASE(op) case op:
+#define NEXT() break
+    while (true) {
+        in = &code[ip++];
+        lineIndex = in->line;
+        switch (in->op) {
+#endif
+
+    CASE(OP_CONST)
+        valueStack.push_back(constantPool[in->a]);
+        NEXT();
+    CASE(OP_LOAD_LOCAL)
+        valueStack.push_back(frameSlots[localBase + in->a]);
+        if (valueStack.back().type() == TYPE_NONE) valueStack.back() = unsetLocal(in->b);
+        NEXT();
+    CASE(OP_LOAD_GLOBAL)
+        valueStack.push_back(variables[in->a]);
+        if (valueStack.back().type() == TYPE_NONE) error("cannot parse value: " + symbolNames[in->b]);
+        NEXT();
+    CASE(OP_STORE_LOCAL)
+        frameSlots[localBase + in->a] = move(valueStack.back());
+        valueStack.pop_back();
+        NEXT();
+    CASE(OP_STORE_GLOBAL)
+        variables[in->a] = move(valueStack.back());
+        valueStack.pop_back();
+        NEXT();
+    CASE(OP_POP)
+        valueStack.pop_back();
+        NEXT();
+    CASE(OP_UNARY)
+        valueStack.back() = unaryMath(valueStack.back(), (Operator)in->a);
+        NEXT();
+    CASE(OP_BINARY) execBinary(*in); NEXT();
+    CASE(OP_ADD_FF) execRealBinary<float, OPR_ADD>(*in); NEXT();
+    CASE(OP_SUB_FF) execRealBinary<float, OPR_SUB>(*in); NEXT();
+    CASE(OP_MUL_FF) execRealBinary<float, OPR_MUL>(*in); NEXT();
+    CASE(OP_LT_FF) execRealBinary<float, OPR_LT>(*in); NEXT();
+    CASE(OP_LE_FF) execRealBinary<float, OPR_LE>(*in); NEXT();
+    CASE(OP_GT_FF) execRealBinary<float, OPR_GT>(*in); NEXT();
+    CASE(OP_GE_FF) execRealBinary<float, OPR_GE>(*in); NEXT();
+    CASE(OP_EQ_FF) execRealBinary<float, OPR_EQ>(*in); NEXT();
+    CASE(OP_NE_FF) execRealBinary<float, OPR_NE>(*in); NEXT();
+    CASE(OP_ADD_II) execIntBinary<OPR_ADD>(*in); NEXT();
+    CASE(OP_SUB_II) execIntBinary<OPR_SUB>(*in); NEXT();
+    CASE(OP_MUL_II) execIntBinary<OPR_MUL>(*in); NEXT();
+    CASE(OP_LT_II) execIntBinary<OPR_LT>(*in); NEXT();
+    CASE(OP_LE_II) execIntBinary<OPR_LE>(*in); NEXT();
+    CASE(OP_GT_II) execIntBinary<OPR_GT>(*in); NEXT();
+    CASE(OP_GE_II) execIntBinary<OPR_GE>(*in); NEXT();
+    CASE(OP_EQ_II) execIntBinary<OPR_EQ>(*in); NEXT();
+    CASE(OP_NE_II) execIntBinary<OPR_NE>(*in); NEXT();
+    CASE(OP_ADD_DD) execRealBinary<double, OPR_ADD>(*in); NEXT();
+    CASE(OP_SUB_DD) execRealBinary<double, OPR_SUB>(*in); NEXT();
+    CASE(OP_MUL_DD) execRealBinary<double, OPR_MUL>(*in); NEXT();
+    CASE(OP_LT_DD) execRealBinary<double, OPR_LT>(*in); NEXT();
+    CASE(OP_LE_DD) execRealBinary<double, OPR_LE>(*in); NEXT();
+    CASE(OP_GT_DD) execRealBinary<double, OPR_GT>(*in); NEXT();
+    CASE(OP_GE_DD) execRealBinary<double, OPR_GE>(*in); NEXT();
+    CASE(OP_EQ_DD) execRealBinary<double, OPR_EQ>(*in); NEXT();
+    CASE(OP_NE_DD) execRealBinary<double, OPR_NE>(*in); NEXT();
+    CASE(OP_LOCAL_CMP_BRANCH)
+        if (fusedCompareBranch(frameSlots[localBase + in->a], code, ip)) NEXT();
+        goto L_plain_load_local;
+    CASE(OP_GLOBAL_CMP_BRANCH)
+        if (fusedCompareBranch(variables[in->a], code, ip)) NEXT();
+        goto L_plain_load_global;
+    CASE(OP_LOCAL_ADD_STORE)
+        if (fusedAddStore(frameSlots[localBase + in->a], code, ip)) NEXT();
+        goto L_plain_load_local;
+    CASE(OP_GLOBAL_ADD_STORE)
+        if (fusedAddStore(variables[in->a], code, ip)) NEXT();
+        goto L_plain_load_global;
+    L_plain_load_local:
+        valueStack.push_back(frameSlots[localBase + in->a]);
+        if (valueStack.back().type() == TYPE_NONE) valueStack.back() = unsetLocal(in->b);
+        NEXT();
+    L_plain_load_global:
+        valueStack.push_back(variables[in->a]);
+        if (valueStack.back().type() == TYPE_NONE) error("cannot parse value: " + symbolNames[in->b]);
+        NEXT();
+    CASE(OP_JUMP_IF_FALSE) {
+        bool cond = truthy(valueStack.back());
+        valueStack.pop_back();
+        if (!cond) ip = in->a;
+        NEXT();
+    }
+    CASE(OP_LOOP)
+        ip = hasErrored ? in->b : in->a;
+        NEXT();
+    CASE(OP_CHECK_FUNC)
+        if (!lookupFunction(in->a)) ip = in->b;
+        NEXT();
+    CASE(OP_CALL) {
+        size_t argBase = valueStack.size() - in->b;
+        functionData* target = resolveCall(chunk->callSites[in->c], in->a);
+        if (!target) {
+            error("unknown function: " + symbolNames[in->a]);
+            valueStack.resize(argBase);
+            valueStack.emplace_back();
+            NEXT();
+        }
+        if (target->isC) {
+            vector<ROSdatatype> args(make_move_iterator(valueStack.begin() + argBase), make_move_iterator(valueStack.end()));
+            valueStack.resize(argBase);
+            valueStack.push_back(callFunction(*target, move(args)));
+            NEXT();
+        }
+        // functions defined while running under the walker are compiled on their first vm call
+        if (!target->chunk) target->chunk = compileChunk(*target->program, target->bodyBegin, target->bodyEnd, true);
+        frames.back().ip = ip;
+        pushFrame(*target, in->b);
+        chunk = target->chunk;
+        code = chunk->code.data();
+        ip = 0;
+        NEXT();
+    }
+    CASE(OP_RETURN) {
+        ROSdatatype retVal = move(valueStack.back());
+        bool last = frames.size() == depth + 1;
+        popFrame();
+        if (last) return;
+        valueStack.push_back(move(retVal));
+        chunk = frames.back().chunk;
+        code = chunk->code.data();
+        ip = frames.back().ip;
+        NEXT();
+    }
+    CASE(OP_DEF)
+        defineFunction(in->a, chunk->protos[in->b]);
+        NEXT();
+    CASE(OP_HELP)
+        printHelp();
+        NEXT();
+    CASE(OP_ERROR)
+        error(chunk->names[in->a]);
+        valueStack.emplace_back();
+        NEXT();
+    CASE(OP_HALT)
+        popFrame();
+        return;
+
+#ifndef ROS_THREADED_DISPATCH
+        }
+    }
+#endif
+#undef CASE
+#undef NEXT
+}
+
+// ---- register VM (engine "reg") ----
+// Function locals are the first frame registers and temporaries follow them, so "var c = a + b"
+// in a function is a single BINARY whose operands name the registers directly.
+
+enum RegOp : unsigned char {
+    R_MOVE,          // dst = a
+    R_UNARY,         // dst = Operator c applied to a
+    R_BINARY,        // dst = a (Operator c) b
+    R_JUMP_IF_FALSE, // jump to dst unless a is truthy
+    R_JUMP_UNLESS,   // jump to dst unless a (Operator c) b holds
+    R_LOOP,          // jump back to dst, or to a if an error is pending; c numbers back edges for the tracer
+    R_CHECK_FUNC,    // jump to dst when symbol a is not a function
+    R_CALL,          // dst = call symbol c with b arguments in registers a.., call site callSites[line of c]
+    R_RETURN,        // return a
+    R_DEF,           // bind symbol a to protos[b]
+    R_HELP,
+    R_ERROR,         // report names[a] and clear dst
+    R_HALT
+};
+
+// operands: a frame register, a constantPool entry or a global slot, tagged in the low two bits
+enum OperandKind { OPND_REG, OPND_CONST, OPND_GLOBAL };
+inline int makeOperand(OperandKind kind, int index) { return index << 2 | kind; }
+
+struct RegInstr {
+    RegOp op;
+    int dst = 0;
+    int a = 0;
+    int b = 0;
+    int c = 0;
+    int site = 0; // CALL: index into RegChunk::callSites
+    int line = 0;
+};
+
+struct RegFrame;
+typedef size_t (*JitEntry)(RegFrame* frame, size_t ip); // returns the ip to resume interpreting at
+typedef size_t (*TraceEntry)(RegFrame* frame);
+
+enum TraceState : unsigned char { TRACE_COLD, TRACE_RECORDING, TRACE_NATIVE, TRACE_BLACKLISTED };
+
+// per back edge state of the tracing jit
+struct LoopTrace {
+    TraceState state = TRACE_COLD;
+    unsigned hits = 0;
+    unsigned failures = 0;
+    TraceEntry entry = nullptr;
+};
+
+struct RegChunk {
+    vector<RegInstr> code;
+    vector<string> names; // error messages
+    vector<functionData*> protos;
+    mutable vector<CallSiteCache> callSites;
+    vector<int> localSymbols; // symbol of each local register, for "cannot parse value"
+    int numRegs = 0; // locals + temporaries
+    mutable unsigned calls = 0;        // tiering counter for the baseline jit
+    mutable JitEntry native = nullptr; // set once jitted
+    int numLoops = 0;
+    mutable vector<LoopTrace> traces; // indexed by a back edge's c
+    int osrEntry = 0; // where a loop compiled for on-stack replacement is entered
+};
+
+vector<unique_ptr<RegChunk>> loadedRegChunks;
+
+RegChunk* compileRegChunk(const vector<Statement>& block, int begin, int end, const functionData* func);
+
+struct RegCompiler {
+    RegChunk& chunk;
+    int numLocals;
+    int temp; // next free temporary; reset after each statement
+    int osrHeader = -1; // loop whose continue point becomes chunk.osrEntry
+
+    int emit(RegOp op, int dst = 0, int a = 0, int b = 0, int c = 0) {
+        RegInstr in;
+        in.op = op; in.dst = dst; in.a = a; in.b = b; in.c = c; in.line = lineIndex;
+        chunk.code.push_back(in);
+        return (int)chunk.code.size() - 1;
+    }
+
+    int newTemp() {
+        int reg = temp++;
+        chunk.numRegs = max(chunk.numRegs, temp);
+        return makeOperand(OPND_REG, reg);
+    }
+
+    int message(const string& text) {
+        for (size_t i = 0; i < chunk.names.size(); i++) if (chunk.names[i] == text) return (int)i;
+        chunk.names.push_back(text);
+        return (int)chunk.names.size() - 1;
+    }
+
+    int variable(const ExprNode& node) {
+        if (!node.var.local) return makeOperand(OPND_GLOBAL, node.var.slot);
+        chunk.localSymbols[node.var.slot] = node.symbol;
+        return makeOperand(OPND_REG, node.var.slot);
+    }
+
+    // operand holding node's value; computed values go to dst when given (-1 = a new temporary)
+    int operand(const ExprNode& node, int dst = -1) {
+        int mark = temp;
+        switch (node.kind) {
+            case ExprNode::Literal:
+                return makeOperand(OPND_CONST, node.constant);
+            case ExprNode::Variable:
+                return variable(node);
+            case ExprNode::Unary: {
+                int a = operand(*node.args[0]);
+                temp = mark;
+                if (dst < 0) dst = newTemp();
+                emit(R_UNARY, dst, a, 0, node.op);
+                return dst;
             }
-            continue;
+            case ExprNode::Binary: {
+                int a = operand(*node.args[0]);
+                // a call on the right may reassign a variable read on the left, so snapshot it first
+                if (!node.args[1]->callFree && (a & 3) != OPND_CONST) { int copy = newTemp(); emit(R_MOVE, copy, a); a = copy; }
+                int b = operand(*node.args[1]);
+                temp = mark;
+                if (dst < 0) dst = newTemp();
+                emit(R_BINARY, dst, a, b, node.op);
+                return dst;
+            }
+            case ExprNode::Call: {
+                int base = temp;
+                for (const auto& arg : node.args) {
+                    int reg = newTemp();
+                    into(reg, *arg);
+                }
+                temp = base;
+                if (dst < 0) dst = newTemp();
+                int call = emit(R_CALL, dst, base, (int)node.args.size(), node.symbol);
+                chunk.code[call].site = (int)chunk.callSites.size();
+                chunk.callSites.emplace_back();
+                chunk.numRegs = max(chunk.numRegs, base + (int)node.args.size());
+                return dst;
+            }
+            default:
+                if (dst < 0) dst = newTemp();
+                emit(R_ERROR, dst, message(node.text));
+                return dst;
         }
-        else if (cmd == "for") {
-            size_t lp = line.find("("), rp = line.find_last_of(')');
-            if (lp == string::npos || rp == string::npos || rp <= lp) { error("invalid for syntax"); lineIndex++; continue; }
-            string inside = strip(sliceStr(line, lp + 1, rp));
+    }
 
-            // split by ';' into init; cond; inc
-            vector<string> parts;
-            string cur; int depth = 0;
-            for (char c : inside) {
-                if (c == '(') depth++; else if (c == ')') depth--;
-                if (c == ';' && depth == 0) { parts.push_back(strip(cur)); cur.clear(); }
-                else cur += c;
-            }
-            if (!cur.empty()) parts.push_back(strip(cur));
-            if (parts.size() != 3) { error("for requires 3 parts"); lineIndex++; continue; }
-            string init = parts[0], cond = parts[1], inc = parts[2];
-
-            // execute init (support "i = x" or "var i = x")
-            auto doAssign = [&](const string& s) {
-                string lhs, rhs; size_t eq = s.find('=');
-                if (eq != string::npos) {
-                    lhs = strip(sliceStr(s, 0, eq));
-                    rhs = strip(sliceStr(s, eq + 1));
-                    currentScope()[lhs] = expression(rhs);
-                } else {
-                    // allow "i + 1" style increment in init too (rare)
-                    vector<string> ts = tokenize(s);
-                    if (ts.size() == 3 && ts[1] == "+") {
-                        ROSdatatype curv = parseValue(ts[0]);
-                        ROSdatatype addv = expression(ts[2]);
-                        ROSdatatype sum = binaryMath(ts[0], "+", ts[2]);
-                        currentScope()[ts[0]] = sum;
+    void into(int dst, const ExprNode& node) {
+        int src = operand(node, dst);
+        if (src != dst) emit(R_MOVE, dst, src);
+    }
+
+    // jump taken when cond is false; comparisons test their operands directly
+    int jumpUnless(const ExprNode& cond) {
+        if (cond.kind == ExprNode::Binary && cond.op >= OPR_LT && cond.op <= OPR_NE) {
+            int a = operand(*cond.args[0]);
+            if (!cond.args[1]->callFree && (a & 3) != OPND_CONST) { int copy = newTemp(); emit(R_MOVE, copy, a); a = copy; }
+            int b = operand(*cond.args[1]);
+            return emit(R_JUMP_UNLESS, 0, a, b, cond.op);
+        }
+        return emit(R_JUMP_IF_FALSE, 0, operand(cond));
+    }
+
+    int target(const VarRef& ref) {
+        return ref.local ? makeOperand(OPND_REG, ref.slot) : makeOperand(OPND_GLOBAL, ref.slot);
+    }
+
+    // exits collects forward jumps out of the body of the loop being compiled, patched to its back edge
+    void range(const vector<Statement>& block, int begin, int end, vector<int>* exits = nullptr) {
+        int savedLineIndex = lineIndex;
+        for (lineIndex = begin; lineIndex < end; lineIndex++) {
+            const Statement& st = block[lineIndex];
+            temp = numLocals;
+            switch (st.kind) {
+                case STMT_EMPTY: case STMT_END:
+                    break;
+                case STMT_VAR:
+                    if (st.names.empty()) { emit(R_ERROR, newTemp(), message("invalid var syntax")); break; }
+                    into(target(st.targets[0]), *st.exprs[0]);
+                    break;
+                case STMT_GLOBAL:
+                    // resolved at load time by resolveProgram
+                    if (st.tokens.size() < 2) emit(R_ERROR, newTemp(), message("global requires a name"));
+                    break;
+                case STMT_DEF:
+                    if (st.tokens.size() < 2) emit(R_ERROR, newTemp(), message("function name missing"));
+                    else {
+                        if (!st.function->regChunk) st.function->regChunk = compileRegChunk(block, lineIndex + 1, st.endIndex, st.function);
+                        chunk.protos.push_back(st.function);
+                        emit(R_DEF, 0, st.symbol, (int)chunk.protos.size() - 1);
                     }
+                    lineIndex = st.endIndex;
+                    break;
+                case STMT_RETURN:
+                    emit(R_RETURN, 0, operand(*st.exprs[0]));
+                    break;
+                case STMT_WHILE: {
+                    int header = lineIndex;
+                    if (st.exprs.empty()) { emit(R_ERROR, newTemp(), message("invalid while syntax")); lineIndex = st.endIndex; break; }
+                    int top = (int)chunk.code.size();
+                    int exitJump = jumpUnless(*st.exprs[0]);
+                    vector<int> bodyExits;
+                    range(block, header + 1, st.endIndex, &bodyExits);
+                    lineIndex = header;
+                    int back = emit(R_LOOP, top, 0, 0, chunk.numLoops++);
+                    for (int jump : bodyExits) chunk.code[jump].dst = chunk.code[jump].a = back;
+                    chunk.code[exitJump].dst = chunk.code[back].a = (int)chunk.code.size();
+                    if (header == osrHeader) chunk.osrEntry = top;
+                    lineIndex = st.endIndex;
+                    break;
                 }
-            };
-            if (init.rfind("var ", 0) == 0) {
-                string rest = strip(sliceStr(init, 4));
-                doAssign(rest);
-            } else {
-                doAssign(init);
-            }
-
-            // capture body
-            vector<string> body;
-            int depth2 = 1;
-            lineIndex++;
-            while (lineIndex < (int)block.size() && depth2 > 0) {
-                vector<string> t = tokenize(block[lineIndex]);
-                if (!t.empty()) {
-                    if (t[0] == "for") depth2++;
-                    else if (t[0] == "end") depth2--;
+                case STMT_FOR: {
+                    int header = lineIndex;
+                    if (st.exprs.size() != 3) { emit(R_ERROR, newTemp(), message("for requires 3 parts")); lineIndex = st.endIndex; break; }
+                    auto assign = [&](const VarRef& ref, const ExprNode& expr) {
+                        temp = numLocals;
+                        if (ref.slot < 0) operand(expr);
+                        else into(target(ref), expr);
+                    };
+                    assign(st.targets[0], *st.exprs[0]);
+                    int top = (int)chunk.code.size();
+                    temp = numLocals;
+                    int exitJump = jumpUnless(*st.exprs[1]);
+                    vector<int> bodyExits;
+                    range(block, header + 1, st.endIndex, &bodyExits);
+                    lineIndex = header;
+                    // errors inside the body skip the increment, as in the other engines
+                    int errorCheck = emit(R_LOOP, (int)chunk.code.size() + 1);
+                    for (int jump : bodyExits) chunk.code[jump].dst = chunk.code[jump].a = errorCheck;
+                    if (header == osrHeader) chunk.osrEntry = errorCheck + 1; // the walker's back edge goes on to the increment
+                    assign(st.targets[1], *st.exprs[2]);
+                    // an error in the increment still tests the condition once more, as in execBlock
+                    emit(R_LOOP, top, top, 0, chunk.numLoops++);
+                    chunk.code[exitJump].dst = chunk.code[errorCheck].a = (int)chunk.code.size();
+                    lineIndex = st.endIndex;
+                    break;
                 }
-                if (depth2 > 0) body.push_back(block[lineIndex]);
-                lineIndex++;
-            }
-
-            auto doInc = [&]() {
-                size_t eq = inc.find('=');
-                if (eq != string::npos) {
-                    string lhs = strip(sliceStr(inc, 0, eq));
-                    string rhs = strip(sliceStr(inc, eq + 1));
-                    currentScope()[lhs] = expression(rhs);
-                } else {
-                    vector<string> ts = tokenize(inc);
-                    if (ts.size() == 3 && ts[1] == "+") {
-                        ROSdatatype sum = binaryMath(ts[0], "+", ts[2]);
-                        currentScope()[ts[0]] = sum;
+                case STMT_HELP:
+                    emit(R_HELP);
+                    break;
+                case STMT_CALL: {
+                    // lines naming no function are skipped, like in the other engines
+                    int check = emit(R_CHECK_FUNC, 0, st.symbol);
+                    if (st.callMissingSpace) {
+                        // the error abandons the innermost block: on to the loop's end, or out of the function
+                        emit(R_ERROR, newTemp(), message("function calls require a space before '('"));
+                        if (st.parent >= 0 && block[st.parent].kind != STMT_DEF) exits->push_back(emit(R_LOOP));
+                        else emit(R_RETURN, 0, makeOperand(OPND_CONST, internConstant(makeReal(0))));
+                    }
+                    else operand(*st.exprs[0]);
+                    chunk.code[check].dst = (int)chunk.code.size();
+                    break;
+                }
+            }
+        }
+        lineIndex = savedLineIndex;
+    }
+};
+
+// func is null for a top-level program
+RegChunk* compileRegChunk(const vector<Statement>& block, int begin, int end, const functionData* func) {
+    loadedRegChunks.push_back(unique_ptr<RegChunk>(new RegChunk()));
+    RegChunk* chunk = loadedRegChunks.back().get();
+    int numLocals = func ? func->numSlots : 0;
+    chunk->localSymbols.assign(numLocals, -1);
+    chunk->numRegs = numLocals;
+    RegCompiler compiler { *chunk, numLocals, numLocals };
+    compiler.range(block, begin, end);
+    if (func) compiler.emit(R_RETURN, 0, makeOperand(OPND_CONST, internConstant(makeReal(0))));
+    else compiler.emit(R_HALT);
+    chunk->traces.resize(chunk->numLoops);
+    return chunk;
+}
+
+// a top-level loop on its own, for on-stack replacement from the walker
+RegChunk* compileOsrChunk(const vector<Statement>& block, int header) {
+    loadedRegChunks.push_back(unique_ptr<RegChunk>(new RegChunk()));
+    RegChunk* chunk = loadedRegChunks.back().get();
+    RegCompiler compiler { *chunk, 0, 0 };
+    compiler.osrHeader = header;
+    compiler.range(block, header, block[header].endIndex + 1);
+    compiler.emit(R_HALT);
+    chunk->traces.resize(chunk->numLoops);
+    return chunk;
+}
+
+// the running chunk's operand storage, shared by the interpreter loop and jitted code
+struct RegFrame {
+    ROSdatatype* bases[3]; // operand kind -> base of its storage; jitted code indexes this directly
+    const RegChunk* chunk;
+
+    void rebase() { bases[OPND_REG] = frameSlots.data() + localBase; }
+
+    const ROSdatatype& read(int x) const {
+        const ROSdatatype& v = bases[x & 3][x >> 2];
+        if (v.type() == TYPE_NONE) return unset(x);
+        return v;
+    }
+    // kept out of line so the error text is not built into every read
+    ROS_NOINLINE const ROSdatatype& unset(int x) const {
+        int index = x >> 2;
+        if ((x & 3) == OPND_GLOBAL) error("cannot parse value: " + symbolNames[index]);
+        else if ((x & 3) == OPND_REG && index < (int)chunk->localSymbols.size() && chunk->localSymbols[index] >= 0)
+            return unsetLocal(chunk->localSymbols[index]);
+        return bases[x & 3][index];
+    }
+    ROSdatatype& write(int x) { return bases[x & 3][x >> 2]; }
+    // numeric loops overwrite numbers with numbers, which needs no release of the old payload
+    template <typename Num>
+    void writeReal(int x, Num v) {
+        ROSdatatype& dst = write(x);
+        if (dst.type() == realKind<Num>) setReal(dst, v);
+        else dst = makeNumber(v);
+    }
+    void writeInt(int x, int64_t i) {
+        ROSdatatype& dst = write(x);
+        if (dst.type() == TYPE_INT) dst.setInt(i);
+        else dst = makeInt(i);
+    }
+};
+
+// instruction semantics shared by the interpreter and the jit's slow paths
+
+void regMove(RegFrame& f, const RegInstr& in) {
+    lineIndex = in.line;
+    const ROSdatatype& src = f.read(in.a);
+    if (src.type() == TYPE_FLOAT) { f.writeReal(in.dst, src.floatValue()); return; }
+    if (src.type() == TYPE_INT) { f.writeInt(in.dst, src.intValue()); return; }
+    if (src.type() == TYPE_DOUBLE) { f.writeReal(in.dst, src.doubleValue()); return; }
+    ROSdatatype value = src;
+    f.write(in.dst) = move(value);
+}
+
+void regUnary(RegFrame& f, const RegInstr& in) {
+    lineIndex = in.line;
+    ROSdatatype value = unaryMath(f.read(in.a), (Operator)in.c);
+    f.write(in.dst) = move(value);
+}
+
+void regBinary(RegFrame& f, const RegInstr& in) {
+    lineIndex = in.line;
+    const ROSdatatype& a = f.read(in.a);
+    const ROSdatatype& b = f.read(in.b);
+    if (a.type() == TYPE_FLOAT && b.type() == TYPE_FLOAT && (in.c == OPR_ADD || in.c == OPR_SUB || in.c == OPR_MUL)) {
+        float x = a.floatValue(), y = b.floatValue();
+        f.writeReal(in.dst, in.c == OPR_ADD ? x + y : in.c == OPR_SUB ? x - y : x * y);
+        return;
+    }
+    if (a.type() == TYPE_DOUBLE && b.type() == TYPE_DOUBLE && (in.c == OPR_ADD || in.c == OPR_SUB || in.c == OPR_MUL)) {
+        double x = a.doubleValue(), y = b.doubleValue();
+        f.writeReal(in.dst, in.c == OPR_ADD ? x + y : in.c == OPR_SUB ? x - y : x * y);
+        return;
+    }
+    if (a.type() == TYPE_INT && b.type() == TYPE_INT && (in.c == OPR_ADD || in.c == OPR_SUB || in.c == OPR_MUL)) {
+        uint64_t x = a.intValue(), y = b.intValue();
+        f.writeInt(in.dst, (int64_t)(in.c == OPR_ADD ? x + y : in.c == OPR_SUB ? x - y : x * y));
+        return;
+    }
+    ROSdatatype value = binaryMath(a, (Operator)in.c, b);
+    f.write(in.dst) = move(value);
+}
+
+bool regTruthy(RegFrame& f, const RegInstr& in) {
+    lineIndex = in.line;
+    return truthy(f.read(in.a));
+}
+
+bool regCompare(RegFrame& f, const RegInstr& in) {
+    lineIndex = in.line;
+    const ROSdatatype& a = f.read(in.a);
+    const ROSdatatype& b = f.read(in.b);
+    if (a.type() == TYPE_FLOAT && b.type() == TYPE_FLOAT) return compareNumbers((Operator)in.c, a.floatValue(), b.floatValue());
+    if (a.type() == TYPE_INT && b.type() == TYPE_INT) return compareNumbers((Operator)in.c, a.intValue(), b.intValue());
+    if (a.type() == TYPE_DOUBLE && b.type() == TYPE_DOUBLE) return compareNumbers((Operator)in.c, a.doubleValue(), b.doubleValue());
+    return truthy(binaryMath(a, (Operator)in.c, b));
+}
+
+// the interpreter loop's inline cases for operands of one numeric kind; false leaves the instruction
+// to regBinary/regCompare, which also report unset variables and type errors
+template <typename T>
+ROS_INLINE T regArith(int op, T x, T y) { return op == OPR_ADD ? x + y : op == OPR_SUB ? x - y : x * y; }
+
+ROS_INLINE bool regBinaryFast(RegFrame& f, const RegInstr& in) {
+    if (in.c != OPR_ADD && in.c != OPR_SUB && in.c != OPR_MUL) return false;
+    const ROSdatatype& a = f.bases[in.a & 3][in.a >> 2];
+    const ROSdatatype& b = f.bases[in.b & 3][in.b >> 2];
+    if (a.type() != b.type()) return false;
+    switch (a.type()) {
+        case TYPE_INT: f.writeInt(in.dst, (int64_t)regArith<uint64_t>(in.c, a.intValue(), b.intValue())); return true;
+        case TYPE_FLOAT: f.writeReal(in.dst, regArith(in.c, a.floatValue(), b.floatValue())); return true;
+        case TYPE_DOUBLE: f.writeReal(in.dst, regArith(in.c, a.doubleValue(), b.doubleValue())); return true;
+        default: return false;
+    }
+}
+
+// sets taken to the comparison's result
+ROS_INLINE bool regCompareFast(RegFrame& f, const RegInstr& in, bool& taken) {
+    const ROSdatatype& a = f.bases[in.a & 3][in.a >> 2];
+    const ROSdatatype& b = f.bases[in.b & 3][in.b >> 2];
+    if (a.type() != b.type()) return false;
+    switch (a.type()) {
+        case TYPE_INT: taken = compareNumbers((Operator)in.c, a.intValue(), b.intValue()); return true;
+        case TYPE_FLOAT: taken = compareNumbers((Operator)in.c, a.floatValue(), b.floatValue()); return true;
+        case TYPE_DOUBLE: taken = compareNumbers((Operator)in.c, a.doubleValue(), b.doubleValue()); return true;
+        default: return false;
+    }
+}
+
+bool regFunctionDefined(RegFrame&, const RegInstr& in) {
+    return lookupFunction(in.a) != nullptr;
+}
+
+// calls a builtin in place; false when the target is a ROS function (or unknown) and needs the interpreter
+bool regCallBuiltin(RegFrame& f, const RegInstr& in) {
+    functionData* target = resolveCall(f.chunk->callSites[in.site], in.c);
+    if (!target || !target->isC) return false;
+    lineIndex = in.line;
+    size_t argBase = localBase + in.a;
+    vector<ROSdatatype> args(frameSlots.begin() + argBase, frameSlots.begin() + argBase + in.b);
+    ROSdatatype value = callFunction(*target, move(args));
+    f.rebase();
+    f.write(in.dst) = move(value);
+    return true;
+}
+
+// ---- baseline jit (engine "jit") ----
+// Once a function has been called jitThreshold times, its register code is translated into an executable
+// buffer, one machine-code template per instruction. Ints and the current real kind get inline fast paths
+// guarded on the type tag. The real kind is float, or double under --double. Everything else calls the
+// helpers above. Jitted code can be entered at any ip. It returns the ip of the first instruction it
+// leaves to the interpreter: ROS calls, returns, defs and errors. Recursion still runs on the frame stack.
+
+const unsigned jitThreshold = 1000;
+
+#ifdef ROS_BASELINE_JIT
+
+struct Assembler {
+    vector<unsigned char> bytes;
+
+    void byte(int b) { bytes.push_back((unsigned char)b); }
+    void bytesOf(initializer_list<int> list) { for (int b : list) byte(b); }
+    void u32(uint32_t v) { for (int i = 0; i < 4; i++) byte(v >> (i * 8)); }
+    void u64(uint64_t v) { for (int i = 0; i < 8; i++) byte(v >> (i * 8)); }
+    size_t pos() const { return bytes.size(); }
+    void patch32(size_t at, uint32_t v) { for (int i = 0; i < 4; i++) bytes[at + i] = (unsigned char)(v >> (i * 8)); }
+};
+
+// general-purpose registers by encoding
+enum JitReg { RAX = 0, RDX = 2, RBX = 3, RSI = 6, RDI = 7 };
+
+struct JitCompiler {
+    const RegChunk& chunk;
+    Assembler as {};
+    vector<size_t> labels {};               // ip -> code offset; labels[size] is a plain exit
+    vector<pair<size_t, int>> jumps {};     // rel32 fixups: offset of the displacement, target ip
+    vector<size_t> exits {};                // rel32 fixups to the epilogue
+    size_t epilogue = 0;
+
+    // reg = address of operand x, loaded from RegFrame::bases (rbx) so the pools may move between entries
+    void address(JitReg reg, int x) {
+        as.bytesOf({ 0x48, 0x8B, 0x43 | reg << 3, (x & 3) * 8 });
+        long offset = (long)(x >> 2) * (long)sizeof(ROSdatatype);
+        if (offset) { as.bytesOf({ 0x48, 0x81, 0xC0 | reg }); as.u32((uint32_t)offset); }
+    }
+    // cmp byte [reg], type ; jne slow
+    void guardType(JitReg reg, ValueType type, vector<size_t>& slow) {
+        as.bytesOf({ 0x80, 0x38 | reg, type });
+        as.bytesOf({ 0x0F, 0x85 }); slow.push_back(as.pos()); as.u32(0);
+    }
+    // scalar SSE op xmm(n), [reg + payload] at the real kind's width (ss or sd); op is the second opcode byte
+    void realOp(int op, int xmm, JitReg reg) {
+        as.bytesOf({ realType == TYPE_DOUBLE ? 0xF2 : 0xF3, 0x0F, op, 0x40 | xmm << 3 | reg, (int)offsetof(ROSdatatype, payload) });
+    }
+    // 64-bit op rax, [reg + payload] (or the reverse for stores); opcode holds the bytes after REX.W
+    void intOp(initializer_list<int> opcode, JitReg reg) {
+        as.byte(0x48);
+        as.bytesOf(opcode);
+        as.bytesOf({ 0x40 | reg, (int)offsetof(ROSdatatype, payload) });
+    }
+    void jumpTo(int cc, int ip) {
+        if (cc < 0) as.byte(0xE9);
+        else as.bytesOf({ 0x0F, cc });
+        jumps.push_back({ as.pos(), ip });
+        as.u32(0);
+    }
+    void bindHere(vector<size_t>& fixups) {
+        for (size_t at : fixups) as.patch32(at, (uint32_t)(as.pos() - at - 4));
+        fixups.clear();
+    }
+    // helper(frame, &in); the bool result, if any, lands in al
+    void callHelper(const void* helper, const RegInstr& in) {
+        as.bytesOf({ 0x48, 0x89, 0xDF });                        // mov rdi, rbx
+        as.bytesOf({ 0x48, 0xBE }); as.u64((uint64_t)&in);      // mov rsi, &in
+        as.bytesOf({ 0x48, 0xB8 }); as.u64((uint64_t)helper);   // mov rax, helper
+        as.bytesOf({ 0xFF, 0xD0 });                              // call rax
+    }
+    void exitAt(int ip) {
+        as.byte(0xB8); as.u32((uint32_t)ip);                     // mov eax, ip
+        as.byte(0xE9); exits.push_back(as.pos()); as.u32(0);
+    }
+    void testAl() { as.bytesOf({ 0x84, 0xC0 }); }
+
+    void instr(int ip) {
+        const RegInstr& in = chunk.code[ip];
+        vector<size_t> slow;
+        switch (in.op) {
+            case R_MOVE: {
+                vector<size_t> notReal;
+                address(RSI, in.a);
+                address(RDI, in.dst);
+                guardType(RSI, realType, notReal);
+                guardType(RDI, realType, slow);
+                realOp(0x10, 0, RSI);                             // movss/movsd xmm0, [rsi]
+                realOp(0x11, 0, RDI);                             // movss/movsd [rdi], xmm0
+                jumpTo(-1, ip + 1);
+                bindHere(notReal);
+                guardType(RSI, TYPE_INT, slow);
+                guardType(RDI, TYPE_INT, slow);
+                intOp({ 0x8B }, RSI);                             // mov rax, [rsi]
+                intOp({ 0x89 }, RDI);                             // mov [rdi], rax
+                jumpTo(-1, ip + 1);
+                bindHere(slow);
+                callHelper((const void*)&regMove, in);
+                break;
+            }
+            case R_BINARY: {
+                int sse = in.c == OPR_ADD ? 0x58 : in.c == OPR_SUB ? 0x5C : in.c == OPR_MUL ? 0x59 : 0;
+                if (sse) {
+                    vector<size_t> notReal;
+                    address(RSI, in.a);
+                    address(RDX, in.b);
+                    address(RDI, in.dst);
+                    guardType(RSI, realType, notReal);
+                    guardType(RDX, realType, slow);
+                    guardType(RDI, realType, slow);
+                    realOp(0x10, 0, RSI);
+                    realOp(sse, 0, RDX);
+                    realOp(0x11, 0, RDI);
+                    jumpTo(-1, ip + 1);
+                    bindHere(notReal);
+                    guardType(RSI, TYPE_INT, slow);
+                    guardType(RDX, TYPE_INT, slow);
+                    guardType(RDI, TYPE_INT, slow);
+                    intOp({ 0x8B }, RSI);
+                    if (in.c == OPR_ADD) intOp({ 0x03 }, RDX);    // add rax, [rdx]
+                    else if (in.c == OPR_SUB) intOp({ 0x2B }, RDX);
+                    else intOp({ 0x0F, 0xAF }, RDX);              // imul rax, [rdx]
+                    intOp({ 0x89 }, RDI);
+                    jumpTo(-1, ip + 1);
+                    bindHere(slow);
+                }
+                callHelper((const void*)&regBinary, in);
+                break;
+            }
+            case R_UNARY:
+                callHelper((const void*)&regUnary, in);
+                break;
+            case R_JUMP_IF_FALSE:
+                callHelper((const void*)&regTruthy, in);
+                testAl();
+                jumpTo(0x84, in.dst);                             // je
+                break;
+            case R_JUMP_UNLESS: {
+                vector<size_t> notReal;
+                address(RSI, in.a);
+                address(RDX, in.b);
+                guardType(RSI, realType, notReal);
+                guardType(RDX, realType, slow);
+                // ucomiss sets "above" for the first operand, so < and <= compare the swapped pair
+                bool swap = in.c == OPR_LT || in.c == OPR_LE;
+                realOp(0x10, 0, swap ? RDX : RSI);
+                realOp(0x10, 1, swap ? RSI : RDX);
+                if (realType == TYPE_DOUBLE) as.byte(0x66);      // ucomisd
+                as.bytesOf({ 0x0F, 0x2E, 0xC1 });                 // ucomiss xmm0, xmm1
+                switch (in.c) {
+                    case OPR_LT: case OPR_GT: jumpTo(0x86, in.dst); break;   // jbe: not above (or unordered)
+                    case OPR_LE: case OPR_GE: jumpTo(0x82, in.dst); break;   // jb
+                    case OPR_EQ: jumpTo(0x85, in.dst); jumpTo(0x8A, in.dst); break; // jne, jp
+                    default: as.bytesOf({ 0x7A, 6 }); jumpTo(0x84, in.dst); break; // jp over; je
+                }
+                jumpTo(-1, ip + 1);
+                bindHere(notReal);
+                guardType(RSI, TYPE_INT, slow);
+                guardType(RDX, TYPE_INT, slow);
+                intOp({ 0x8B }, RSI);
+                intOp({ 0x3B }, RDX);                             // cmp rax, [rdx]
+                switch (in.c) {                                   // signed jcc on the failing condition
+                    case OPR_LT: jumpTo(0x8D, in.dst); break;     // jge
+                    case OPR_LE: jumpTo(0x8F, in.dst); break;     // jg
+                    case OPR_GT: jumpTo(0x8E, in.dst); break;     // jle
+                    case OPR_GE: jumpTo(0x8C, in.dst); break;     // jl
+                    case OPR_EQ: jumpTo(0x85, in.dst); break;     // jne
+                    default: jumpTo(0x84, in.dst); break;         // je
+                }
+                jumpTo(-1, ip + 1);
+                bindHere(slow);
+                callHelper((const void*)&regCompare, in);
+                testAl();
+                jumpTo(0x84, in.dst);
+                break;
+            }
+            case R_LOOP:
+                as.bytesOf({ 0x48, 0xB8 }); as.u64((uint64_t)&hasErrored);  // mov rax, &hasErrored
+                as.bytesOf({ 0x80, 0x38, 0x00 });                           // cmp byte [rax], 0
+                jumpTo(0x85, in.a);
+                jumpTo(-1, in.dst);
+                break;
+            case R_CHECK_FUNC:
+                callHelper((const void*)&regFunctionDefined, in);
+                testAl();
+                jumpTo(0x84, in.dst);
+                break;
+            case R_CALL: {
+                // builtins go through the regCallBuiltin trampoline; ROS functions exit to the interpreter
+                callHelper((const void*)&regCallBuiltin, in);
+                testAl();
+                as.bytesOf({ 0x0F, 0x85 }); slow.push_back(as.pos()); as.u32(0);   // jne next
+                exitAt(ip);
+                bindHere(slow);
+                break;
+            }
+            default:
+                exitAt(ip);
+                break;
+        }
+    }
+
+    JitEntry compile() {
+        int n = (int)chunk.code.size();
+        labels.resize(n + 1);
+        as.byte(0x53);                                    // push rbx
+        as.bytesOf({ 0x48, 0x89, 0xFB });                 // mov rbx, rdi
+        as.bytesOf({ 0x48, 0x8D, 0x05 });                 // lea rax, [rip + table]
+        size_t tableRef = as.pos(); as.u32(0);
+        as.bytesOf({ 0xFF, 0x24, 0xF0 });                 // jmp [rax + rsi*8]
+        for (int ip = 0; ip < n; ip++) { labels[ip] = as.pos(); instr(ip); }
+        labels[n] = as.pos();
+        exitAt(n);
+        epilogue = as.pos();
+        bindHere(exits);
+        as.byte(0x5B);                                    // pop rbx
+        as.byte(0xC3);                                    // ret
+        for (auto& j : jumps) as.patch32(j.first, (uint32_t)(labels[j.second] - j.first - 4));
+        while (as.pos() % 8) as.byte(0xCC);
+        size_t table = as.pos();
+        as.patch32(tableRef, (uint32_t)(table - tableRef - 4));
+        for (int ip = 0; ip < n; ip++) as.u64(0);
+
+        size_t size = as.pos();
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return nullptr;
+        unsigned char* code = (unsigned char*)mem;
+        for (int ip = 0; ip < n; ip++) {
+            uint64_t target = (uint64_t)(code + labels[ip]);
+            for (int i = 0; i < 8; i++) as.bytes[table + ip * 8 + i] = (unsigned char)(target >> (i * 8));
+        }
+        copy(as.bytes.begin(), as.bytes.end(), code);
+        if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) { munmap(mem, size); return nullptr; }
+        return (JitEntry)mem;
+    }
+};
+
+static_assert(sizeof(ROSdatatype) == 16 && offsetof(RegFrame, bases) == 0, "jit templates assume this layout");
+
+void jitCompile(const RegChunk& chunk) {
+    chunk.native = JitCompiler { chunk }.compile();
+}
+
+#else
+
+void jitCompile(const RegChunk&) {} // no backend: jit stays on the register interpreter
+
+#endif
+
+// ---- tracing jit (engine "trace") ----
+// A loop whose back edge is taken traceThreshold times is recorded: the interpreter logs the ips of one
+// trip around the body. If that path is straight-line int and float (or double) arithmetic and comparisons
+// whose slots keep their types, it is compiled to native code that guards those types on entry, keeps real
+// slots in xmm registers and int slots in general registers across iterations, and side-exits back to the
+// interpreter (writing the slots back) wherever a branch goes the other way than it did while recording.
+
+const unsigned traceThreshold = 100;
+const size_t maxTraceLength = 256;
+const unsigned maxTraceFailures = 100; // entry guard failures before a trace is dropped
+const size_t noTraceExit = (size_t)-1; // trace entry guard failed; nothing was executed
+
+struct TraceRecorder {
+    const RegChunk* chunk = nullptr; // null when not recording
+    int loop = -1;
+    int top = 0;
+    int backEdge = 0;
+    vector<int> ips;
+} recorder;
+
+void abandonTrace() {
+    recorder.chunk->traces[recorder.loop].state = TRACE_BLACKLISTED;
+    recorder.chunk = nullptr;
+}
+
+// called for every instruction the interpreter executes while recording
+void recordStep(const RegChunk* chunk, size_t ip) {
+    if (chunk != recorder.chunk || (int)ip < recorder.top || (int)ip > recorder.backEdge || recorder.ips.size() >= maxTraceLength) abandonTrace();
+    else recorder.ips.push_back((int)ip);
+}
+
+#ifdef ROS_BASELINE_JIT
+
+struct TraceCompiler {
+    const RegFrame& frame;
+    const vector<int>& ips; // loop top first, back edge last
+    Assembler as {};
+    unordered_map<int, int> regOf {};       // slot operand -> xmm register (floats) or general register (ints)
+    unordered_map<int, ValueType> typeOf {}; // slot operand -> the type it holds on every trip
+    ValueType real = TYPE_NONE;             // the one real kind (float or double) the trace computes in
+    vector<int> slots {};
+    int floatSlots = 0, intSlots = 0;
+    vector<pair<size_t, int>> sideExits {}; // rel32 fixup, ip to resume at
+    vector<size_t> fails {};                // rel32 fixups to the entry guard failure path
+
+    // ints live in rcx, rsi, rdi, r8-r11; rax and rdx are scratch and rbx holds the frame
+    static constexpr int intRegs[] = { 1, 6, 7, 8, 9, 10, 11 };
+
+    ValueType type(int x) const {
+        if ((x & 3) == OPND_CONST) return constantPool[x >> 2].type();
+        auto it = typeOf.find(x);
+        return it == typeOf.end() ? TYPE_NONE : it->second;
+    }
+    bool isReal(ValueType t) const { return t == TYPE_FLOAT || t == TYPE_DOUBLE; }
+    bool takeReal(ValueType t) {
+        if (real == TYPE_NONE) real = t;
+        return real == t;
+    }
+    bool useSlot(int x) {
+        if ((x & 3) == OPND_CONST) return type(x) == TYPE_INT || (isReal(type(x)) && takeReal(type(x)));
+        if (typeOf.count(x)) return true;
+        // the type is taken from the slot as it is now and guarded on entry
+        ValueType t = frame.bases[x & 3][x >> 2].type();
+        if (isReal(t) && takeReal(t) && floatSlots < 14) regOf[x] = 2 + floatSlots++;   // xmm0/xmm1 are scratch
+        else if (t == TYPE_INT && intSlots < 7) regOf[x] = intRegs[intSlots++];
+        else return false;
+        typeOf[x] = t;
+        slots.push_back(x);
+        return true;
+    }
+    // a write must keep the slot's type, so the entry guards hold on every trip
+    bool writes(int x, ValueType t) { return useSlot(x) && type(x) == t; }
+    ValueType resultType(const RegInstr& in) const {
+        return type(in.a) == TYPE_INT && type(in.b) == TYPE_INT ? TYPE_INT : real;
+    }
+
+    // every instruction on the path must be int or float arithmetic and the path must close the loop
+    bool collect() {
+        const RegInstr& back = frame.chunk->code[ips.back()];
+        if (back.op != R_LOOP || back.dst != ips.front()) return false;
+        for (size_t k = 0; k + 1 < ips.size(); k++) {
+            const RegInstr& in = frame.chunk->code[ips[k]];
+            switch (in.op) {
+                case R_MOVE:
+                    if (!useSlot(in.a) || !writes(in.dst, type(in.a))) return false;
+                    break;
+                case R_BINARY:
+                    if (in.c != OPR_ADD && in.c != OPR_SUB && in.c != OPR_MUL) return false;
+                    if (!useSlot(in.a) || !useSlot(in.b) || !writes(in.dst, resultType(in))) return false;
+                    break;
+                case R_JUMP_UNLESS:
+                    if (in.c < OPR_LT || in.c > OPR_NE || !useSlot(in.a) || !useSlot(in.b)) return false;
+                    break;
+                case R_LOOP:
+                    // a for loop's error check; an inner loop's back edge means a nested loop, left to its own trace
+                    if (in.dst != ips[k] + 1) return false;
+                    break;
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void loadBase(int x) { as.bytesOf({ 0x48, 0x8B, 0x43, (x & 3) * 8 }); } // mov rax, [rbx + kind*8]
+    int scalar() const { return real == TYPE_DOUBLE ? 0xF2 : 0xF3; }         // ss or sd prefix
+    uint32_t at(int x) { return (uint32_t)((x >> 2) * sizeof(ROSdatatype)); }
+    uint32_t payload(int x) { return at(x) + (uint32_t)offsetof(ROSdatatype, payload); }
+    // prefix 0F op with xmm operands, or with [rax + disp32] as the second operand when disp is given
+    void sse(int prefix, int op, int reg, int rm) {
+        if (prefix) as.byte(prefix);
+        if (reg >= 8 || rm >= 8) as.byte(0x40 | (reg >= 8) << 2 | (rm >= 8));
+        as.bytesOf({ 0x0F, op, 0xC0 | (reg & 7) << 3 | (rm & 7) });
+    }
+    void sseMem(int prefix, int op, int reg, uint32_t disp) {
+        if (prefix) as.byte(prefix);
+        if (reg >= 8) as.byte(0x44);
+        as.bytesOf({ 0x0F, op, 0x80 | (reg & 7) << 3 });
+        as.u32(disp);
+    }
+    // 64-bit op with register operands, or with [rax + disp32] as the r/m operand for gprMem
+    void gpr(initializer_list<int> op, int reg, int rm) {
+        as.byte(0x48 | (reg >= 8) << 2 | (rm >= 8));
+        as.bytesOf(op);
+        as.byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+    }
+    void gprMem(int op, int reg, uint32_t disp) {
+        as.bytesOf({ 0x48 | (reg >= 8) << 2, op, 0x80 | (reg & 7) << 3 });
+        as.u32(disp);
+    }
+    void loadInt(int reg, int x) {
+        if ((x & 3) != OPND_CONST) { gpr({ 0x8B }, reg, regOf[x]); return; }    // mov reg, slot
+        as.bytesOf({ 0x48 | (reg >= 8), 0xB8 | (reg & 7) });                    // mov reg, imm64
+        as.u64((uint64_t)constantPool[x >> 2].intValue());
+    }
+    void load(int xmm, int x) {
+        if ((x & 3) != OPND_CONST) {
+            if (type(x) != TYPE_INT) { sse(0, 0x28, xmm, regOf[x]); return; }     // movaps
+            int reg = regOf[x];                                                  // cvtsi2ss/cvtsi2sd xmm, reg
+            as.bytesOf({ scalar(), 0x48 | (xmm >= 8) << 2 | (reg >= 8), 0x0F, 0x2A, 0xC0 | (xmm & 7) << 3 | (reg & 7) });
+            return;
+        }
+        if (real == TYPE_DOUBLE) {
+            double value = asReal<double>(constantPool[x >> 2]);
+            uint64_t bits;
+            memcpy(&bits, &value, 8);
+            as.bytesOf({ 0x48, 0xB8 }); as.u64(bits);                       // mov rax, bits
+            as.bytesOf({ 0x66, 0x48 | (xmm >= 8) << 2, 0x0F, 0x6E, 0xC0 | (xmm & 7) << 3 });   // movq xmm, rax
+            return;
+        }
+        float value = asReal<float>(constantPool[x >> 2]);
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        as.byte(0xB8); as.u32(bits);                                        // mov eax, bits
+        sse(0x66, 0x6E, xmm, 0);                                            // movd xmm, eax
+    }
+    void sideExit(int cc, int ip) {
+        as.bytesOf({ 0x0F, cc });
+        sideExits.push_back({ as.pos(), ip });
+        as.u32(0);
+    }
+    void bind(size_t at, size_t target) { as.patch32(at, (uint32_t)(target - at - 4)); }
+
+    TraceEntry compile() {
+        if (!collect()) return nullptr;
+        as.byte(0x53);                                    // push rbx
+        as.bytesOf({ 0x48, 0x89, 0xFB });                 // mov rbx, rdi
+        for (int x : slots) {
+            loadBase(x);
+            as.bytesOf({ 0x80, 0xB8 }); as.u32(at(x) + offsetof(ROSdatatype, tag)); as.byte(type(x)); // cmp byte [rax + type], t
+            as.bytesOf({ 0x0F, 0x85 }); fails.push_back(as.pos()); as.u32(0);
+            if (type(x) != TYPE_INT) sseMem(scalar(), 0x10, regOf[x], payload(x)); // movss/movsd xmm, [rax + payload]
+            else gprMem(0x8B, regOf[x], payload(x));                                // mov reg, [rax + payload]
+        }
+        size_t body = as.pos();
+        for (size_t k = 0; k + 1 < ips.size(); k++) {
+            const RegInstr& in = frame.chunk->code[ips[k]];
+            switch (in.op) {
+                case R_MOVE:
+                    if (type(in.dst) == TYPE_INT) loadInt(regOf[in.dst], in.a);
+                    else { load(0, in.a); sse(0, 0x28, regOf[in.dst], 0); }
+                    break;
+                case R_BINARY: {
+                    if (resultType(in) == TYPE_INT) {
+                        // rax = a op b, wrapping like the interpreter
+                        loadInt(0, in.a);
+                        int b = 2;
+                        if ((in.b & 3) == OPND_CONST) loadInt(2, in.b);
+                        else b = regOf[in.b];
+                        if (in.c == OPR_ADD) gpr({ 0x03 }, 0, b);
+                        else if (in.c == OPR_SUB) gpr({ 0x2B }, 0, b);
+                        else gpr({ 0x0F, 0xAF }, 0, b);
+                        gpr({ 0x89 }, 0, regOf[in.dst]);    // mov dst, rax
+                        break;
+                    }
+                    int op = in.c == OPR_ADD ? 0x58 : in.c == OPR_SUB ? 0x5C : 0x59;
+                    load(0, in.a);
+                    if ((in.b & 3) == OPND_CONST || type(in.b) == TYPE_INT) { load(1, in.b); sse(scalar(), op, 0, 1); }
+                    else sse(scalar(), op, 0, regOf[in.b]);
+                    sse(0, 0x28, regOf[in.dst], 0);
+                    break;
+                }
+                case R_JUMP_UNLESS: {
+                    bool held = ips[k + 1] == ips[k] + 1;
+                    if (resultType(in) == TYPE_INT) {
+                        loadInt(0, in.a);
+                        loadInt(2, in.b);
+                        gpr({ 0x3B }, 0, 2);                  // cmp rax, rdx
+                        // signed jcc: leave when a condition recorded as holding fails, or one recorded failing holds
+                        static const int failing[] = { 0x8D, 0x8F, 0x8E, 0x8C, 0x85, 0x84 };   // LT LE GT GE EQ NE
+                        int cc = failing[in.c - OPR_LT];
+                        if (held) sideExit(cc, in.dst);
+                        else sideExit(cc ^ 1, ips[k] + 1);
+                        break;
+                    }
+                    bool swap = in.c == OPR_LT || in.c == OPR_LE;
+                    load(0, swap ? in.b : in.a);
+                    load(1, swap ? in.a : in.b);
+                    if (real == TYPE_DOUBLE) as.byte(0x66);  // ucomisd
+                    as.bytesOf({ 0x0F, 0x2E, 0xC1 });         // ucomiss xmm0, xmm1
+                    if (held) {
+                        // recorded with the condition holding: leave when it fails
+                        switch (in.c) {
+                            case OPR_LT: case OPR_GT: sideExit(0x86, in.dst); break;
+                            case OPR_LE: case OPR_GE: sideExit(0x82, in.dst); break;
+                            case OPR_EQ: sideExit(0x85, in.dst); sideExit(0x8A, in.dst); break;
+                            default: as.bytesOf({ 0x7A, 6 }); sideExit(0x84, in.dst); break;
+                        }
                     } else {
-                        // generic expression evaluated but result ignored
-                        (void)expression(inc);
+                        // recorded with the condition failing: leave when it holds
+                        switch (in.c) {
+                            case OPR_LT: case OPR_GT: sideExit(0x87, ips[k] + 1); break;
+                            case OPR_LE: case OPR_GE: sideExit(0x83, ips[k] + 1); break;
+                            case OPR_EQ: as.bytesOf({ 0x7A, 6 }); sideExit(0x84, ips[k] + 1); break;
+                            default: sideExit(0x85, ips[k] + 1); sideExit(0x8A, ips[k] + 1); break;
+                        }
                     }
+                    break;
                 }
-            };
+                default:
+                    break;
+            }
+        }
+        as.byte(0xE9); as.u32(0); bind(as.pos() - 4, body);   // next iteration, slots still in registers
+
+        // side exits: write every slot back, then resume the interpreter at the recorded ip
+        vector<size_t> toWriteBack;
+        for (auto& exit : sideExits) {
+            bind(exit.first, as.pos());
+            as.byte(0xBA); as.u32((uint32_t)exit.second);  // mov edx, ip
+            as.byte(0xE9); toWriteBack.push_back(as.pos()); as.u32(0);
+        }
+        for (size_t at : toWriteBack) bind(at, as.pos());
+        for (int x : slots) {
+            loadBase(x);
+            if (type(x) != TYPE_INT) sseMem(scalar(), 0x11, regOf[x], payload(x)); // movss/movsd [rax + payload], xmm
+            else gprMem(0x89, regOf[x], payload(x));                                // mov [rax + payload], reg
+        }
+        as.bytesOf({ 0x89, 0xD0 });                       // mov eax, edx
+        size_t epilogue = as.pos();
+        as.byte(0x5B);                                    // pop rbx
+        as.byte(0xC3);                                    // ret
+        for (size_t at : fails) bind(at, as.pos());
+        as.bytesOf({ 0x48, 0xC7, 0xC0, 0xFF, 0xFF, 0xFF, 0xFF });   // mov rax, noTraceExit
+        as.byte(0xE9); as.u32(0); bind(as.pos() - 4, epilogue);
+
+        size_t size = as.pos();
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return nullptr;
+        copy(as.bytes.begin(), as.bytes.end(), (unsigned char*)mem);
+        if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) { munmap(mem, size); return nullptr; }
+        return (TraceEntry)mem;
+    }
+};
 
-            while (true) {
-                ROSdatatype cv = expression(cond);
-                if (!truthy(cast(cv, "bool"))) break;
-                execBlock(body);
-                if (hasErrored) break;
-                doInc();
+TraceEntry compileTrace(const RegFrame& frame, const vector<int>& ips) {
+    return TraceCompiler { frame, ips }.compile();
+}
+
+#else
+
+TraceEntry compileTrace(const RegFrame&, const vector<int>&) { return nullptr; }
+
+#endif
+
+// R_LOOP taking its back edge under the trace engine; returns the ip to continue at
+size_t loopBackEdge(RegFrame& frame, const RegInstr& in, int at) {
+    LoopTrace& trace = frame.chunk->traces[in.c];
+    switch (trace.state) {
+        case TRACE_NATIVE: {
+            size_t exit = trace.entry(&frame);
+            if (exit != noTraceExit) return exit;
+            if (++trace.failures == maxTraceFailures) trace.state = TRACE_BLACKLISTED;
+            break;
+        }
+        case TRACE_COLD:
+            if (++trace.hits >= traceThreshold && !recorder.chunk) {
+                trace.state = TRACE_RECORDING;
+                recorder.chunk = frame.chunk;
+                recorder.loop = in.c;
+                recorder.top = in.dst;
+                recorder.backEdge = at;
+                recorder.ips.clear();
             }
-            continue;
+            break;
+        case TRACE_RECORDING:
+            recorder.chunk = nullptr;
+            trace.entry = compileTrace(frame, recorder.ips);
+            trace.state = trace.entry ? TRACE_NATIVE : TRACE_BLACKLISTED;
+            break;
+        default:
+            break;
+    }
+    return in.dst;
+}
+
+// tier picks the register vm, baseline jit or tracing jit; entry is the ip to start at.
+// Returns true when the chunk ended with a return rather than running off its end.
+bool runRegChunk(const RegChunk& mainChunk, Engine tier, size_t entry = 0) {
+    size_t depth = frames.size();
+    Frame top;
+    top.valueBase = valueStack.size();
+    top.regChunk = &mainChunk;
+    enterFrame(top);
+    frameSlots.resize(localBase + mainChunk.numRegs);
+
+    RegFrame frame { { frameSlots.data() + localBase, constantPool.data(), variables.data() }, &mainChunk };
+    const RegChunk*& chunk = frame.chunk;
+    // the running chunk's code stays in a local, reloaded only when a call or return switches chunks
+    const RegInstr* code = chunk->code.data();
+    size_t ip = entry;
+    bool jit = tier == Engine::BaselineJIT || tier == Engine::TracingJIT;
+    bool tracing = tier == Engine::TracingJIT;
+
+    while (true) {
+        // the plain register tier never enters machine code or records traces
+        if (jit) {
+            if (chunk->native) ip = chunk->native(&frame, ip);
+            if (recorder.chunk) recordStep(chunk, ip);
+        }
+        const RegInstr& in = code[ip++];
+        lineIndex = in.line;
+
+        switch (in.op) {
+            case R_MOVE:
+                regMove(frame, in);
+                break;
+            case R_UNARY:
+                regUnary(frame, in);
+                break;
+            case R_BINARY:
+                if (!regBinaryFast(frame, in)) regBinary(frame, in);
+                break;
+            case R_JUMP_IF_FALSE:
+                if (!regTruthy(frame, in)) ip = in.dst;
+                break;
+            case R_JUMP_UNLESS: {
+                bool taken;
+                if (!regCompareFast(frame, in, taken)) taken = regCompare(frame, in);
+                if (!taken) ip = in.dst;
+                break;
+            }
+            case R_LOOP:
+                if (hasErrored) ip = in.a;
+                else if (tracing && in.dst < (int)ip) ip = loopBackEdge(frame, in, (int)ip - 1);
+                else ip = in.dst;
+                break;
+            case R_CHECK_FUNC:
+                if (!lookupFunction(in.a)) ip = in.dst;
+                break;
+            case R_CALL: {
+                if (regCallBuiltin(frame, in)) break;
+                functionData* target = resolveCall(chunk->callSites[in.site], in.c);
+                size_t argBase = localBase + in.a;
+                if (!target) {
+                    error("unknown function: " + symbolNames[in.c]);
+                    frame.write(in.dst) = ROSdatatype();
+                    break;
+                }
+                if (!target->regChunk) {
+                    target->regChunk = compileRegChunk(*target->program, target->bodyBegin, target->bodyEnd, target);
+                    // compiling interns the implicit return value, which can move the constant pool
+                    frame.bases[OPND_CONST] = constantPool.data();
+                }
+                if (jit && !target->regChunk->native && ++target->regChunk->calls == jitThreshold) jitCompile(*target->regChunk);
+                frames.back().ip = ip;
+                Frame f;
+                f.function = target;
+                f.valueBase = valueStack.size();
+                f.regChunk = target->regChunk;
+                enterFrame(f);
+                frameSlots.resize(localBase + target->regChunk->numRegs);
+                frame.rebase();
+                for (int i = 0; i < target->numArgs; i++) {
+                    if (i < in.b) frameSlots[localBase + i] = move(frameSlots[argBase + i]);
+                    else frameSlots[localBase + i] = makeReal(0);
+                }
+                hasErrored = false;
+                chunk = target->regChunk;
+                code = chunk->code.data();
+                ip = 0;
+                break;
+            }
+            case R_RETURN: {
+                ROSdatatype retVal = frame.read(in.a);
+                bool last = frames.size() == depth + 1;
+                popFrame();
+                if (last) return true;
+                chunk = frames.back().regChunk;
+                code = chunk->code.data();
+                ip = frames.back().ip;
+                frame.rebase();
+                frame.write(code[ip - 1].dst) = move(retVal);
+                break;
+            }
+            case R_DEF:
+                defineFunction(in.a, chunk->protos[in.b]);
+                break;
+            case R_HELP:
+                printHelp();
+                break;
+            case R_ERROR:
+                error(chunk->names[in.a]);
+                frame.write(in.dst) = ROSdatatype();
+                break;
+            case R_HALT:
+                popFrame();
+                return false;
         }
-        else if (cmd == "help") {
-            print("ROS++ interpreter");
-            print("Commands: print, var, def, return, while, for, global, end");
-            print("var <name> = <expression>");
-            print("var x = add (10, 2) + 32 / 3  * (54 + 2)");
-            print("");
-            print("def <name> (arg1, arg2 ...)");
-            print("return <expression>");
-            print("end");
-            print("");
-            print("def add (a, b)");
-            print("return a + b");
-            print("end");
-            print("");
-            print("while (<expression>)");
-            print("end");
-            print("while (true)");
-            print("print 'yes'");
-            print("end");
-            print("");
-            print("for (<var> = <expression>; <expression>; <expression>)");
-            print("end");
-            print("for (i = 0; i != 10; i + 1)");
-            print("print i");
-            print("end");
-        }
-
-        lineIndex++;
     }
-    lineIndex = savedLineIndex;
+}
+
+// Globals are shared by every engine and a top-level frame has no locals, so the walker's state carries
+// over as is; the loop runs to completion in the most optimizing tier available.
+bool osrLoop(const vector<Statement>& block, int header) {
+    const Statement& st = block[header];
+    if (!st.osrChunk) st.osrChunk = compileOsrChunk(block, header);
+    return runRegChunk(*st.osrChunk, Engine::TracingJIT, st.osrChunk->osrEntry);
 }
 
 ROSdatatype ROSprint(const vector<ROSdatatype>& args) {
     string toprint;
     for (const auto& arg : args) {
-        toprint += cast(arg, "string").stringValue;
+        toprint += cast(arg, TYPE_STRING).stringValue();
     }
     print(toprint);
     
-    ROSdatatype r; r.floatValue = 0.0f; r.type = "float";
-    return r;
+    return makeReal(0);
+}
+
+void runProgram(const vector<string>& source) {
+    const vector<Statement>& program = compileProgram(source);
+    if (engine == Engine::StackVM) runChunk(*compileChunk(program, 0, (int)program.size(), false));
+    else if (engine != Engine::Walker) runRegChunk(*compileRegChunk(program, 0, (int)program.size(), nullptr), engine);
+    else execBlock(program, 0, (int)program.size());
+}
+
+// --bench file...: runs each workload on every engine in float and then double mode, best of 3, with
+// program output muted; speedups are against the plain walker in the same mode
+int runBenchmarks(const vector<string>& files) {
+    // "walker" is the plain tree walker and "osr" the walker moving hot top-level loops to compiled code
+    const char* engineNames[] = { "walker", "osr", "vm", "reg", "jit", "trace" };
+    cout << "values are " << sizeof(ROSdatatype) << " bytes" << endl;
+    for (const string& file : files) {
+        ifstream in(file);
+        if (!in) { cerr << "cannot open " << file << endl; return 1; }
+        vector<string> source;
+        for (string line; getline(in, line);) source.push_back(line);
+
+        cout << file << endl;
+        for (ValueType mode : { TYPE_FLOAT, TYPE_DOUBLE }) {
+            realType = mode;
+            double walkerTime = 0;
+            for (const char* name : engineNames) {
+                bool osr = name == string("osr");
+                selectEngine(osr ? "walker" : name);
+                osrEnabled = osr;
+                double best = 1e30;
+                for (int run = 0; run < 3; run++) {
+                    streambuf* saved = cout.rdbuf(nullptr);
+                    auto start = chrono::high_resolution_clock::now();
+                    runProgram(source);
+                    chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - start;
+                    cout.rdbuf(saved);
+                    best = min(best, elapsed.count());
+                }
+                if (!osr && engine == Engine::Walker) walkerTime = best;
+                cout << "  " << typeName(mode) << "\t" << name << "\t" << best << " s\t" << walkerTime / best << "x" << endl;
+            }
+        }
+    }
+    return 0;
 }
 
+// ---- ahead-of-time compiler (--compile out file) ----
+// Translates a program into C++ written against aotRuntime, a header that mirrors ROSdatatype, cast and
+// the operator kernels above, then builds it with the local c++. Statements map onto the register vm's
+// layout: locals are a per-call array indexed by resolver slot and globals a table indexed by symbol.
+
+const char* aotRuntime = R"ROS(// ROS++ runtime for programs translated with --compile
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#if defined(__unix__)
+#include <pthread.h>
+#endif
+#ifndef ROS_REAL
+#define ROS_REAL float
+#endif
+
+namespace ros {
+
+// FLOAT values hold the real kind the program was compiled for: float, or double under --double
+typedef ROS_REAL real;
+const char* const realName = sizeof(real) == sizeof(double) ? "double" : "float";
+
+// no ROS++ expression builds a list, so translated programs only ever see these
+enum Type : unsigned char { NONE, FLOAT, INT, BOOL, STRING };
+enum Op : unsigned char { INDEX, INC, DEC, NOT, MUL, DIV, IDIV, ADD, SUB, LT, LE, GT, GE, EQ, NE, AND, OR };
+const char* const opText[] = { "index", "++", "--", "not", "*", "/", "//", "+", "-", "<", "<=", ">", ">=", "==", "!=", "and", "or" };
+
+struct Value {
+    Type type = NONE;
+    union { real f; int64_t i; bool b; };
+    std::shared_ptr<const std::string> s;
+    Value() : f(0) {}
+};
+
+inline Value num(real f) { Value v; v.type = FLOAT; v.f = f; return v; }
+inline Value integer(int64_t i) { Value v; v.type = INT; v.i = i; return v; }
+inline Value boolean(bool b) { Value v; v.type = BOOL; v.b = b; return v; }
+inline Value str(std::string s) { Value v; v.type = STRING; v.s = std::make_shared<const std::string>(std::move(s)); return v; }
+
+int line = 0;
+bool hasErrored = false;
+std::vector<std::string> symbolNames;
+
+void error(const std::string& msg) {
+    std::cerr << "Error: " << msg << " at line " << line << std::endl;
+    hasErrored = true;
+}
+
+std::string toString(const Value& v) {
+    switch (v.type) {
+        case FLOAT: { std::ostringstream ss; ss << std::setprecision(std::numeric_limits<real>::digits10) << v.f; return ss.str(); }
+        case INT: return std::to_string(v.i);
+        case BOOL: return v.b ? "true" : "false";
+        case STRING: return *v.s;
+        default: return "";
+    }
+}
 
-int main() {
+bool truthy(const Value& v) {
+    switch (v.type) {
+        case BOOL: return v.b;
+        case FLOAT: return v.f != 0;
+        case INT: return v.i != 0;
+        case STRING: return !v.s->empty();
+        default: return false;
+    }
+}
+
+// a variable read: unset variables report and yield none
+inline const Value& get(const Value& v, int symbol) {
+    if (v.type == NONE) error("cannot parse value: " + symbolNames[symbol]);
+    return v;
+}
+
+// a local read: before its first assignment it reads the global of the same name
+inline const Value& get(const Value& v, const Value& global, int symbol) {
+    return v.type == NONE ? get(global, symbol) : v;
+}
+
+inline real asReal(const Value& v) { return v.type == INT ? (real)v.i : v.f; }
+
+Value binarySlow(const Value& a, Op op, const Value& b) {
+    if (a.type == INT && b.type == INT) {
+        // ints wrap on overflow; "/" divides as the real kind, "//" stays in ints
+        int64_t x = a.i, y = b.i;
+        switch (op) {
+            case ADD: return integer((int64_t)((uint64_t)x + (uint64_t)y));
+            case SUB: return integer((int64_t)((uint64_t)x - (uint64_t)y));
+            case MUL: return integer((int64_t)((uint64_t)x * (uint64_t)y));
+            case DIV: return binarySlow(num((real)x), DIV, num((real)y));
+            case IDIV:
+                if (y == 0) { error("Division by zero"); std::exit(1); }
+                return integer(y == -1 ? (int64_t)(0 - (uint64_t)x) : x / y);
+            case EQ: return boolean(x == y);
+            case NE: return boolean(x != y);
+            case GT: return boolean(x > y);
+            case LT: return boolean(x < y);
+            case GE: return boolean(x >= y);
+            case LE: return boolean(x <= y);
+            default: error(std::string("Unsupported int op: ") + opText[op]); return Value();
+        }
+    }
+    if ((a.type == FLOAT || a.type == INT) && (b.type == FLOAT || b.type == INT)) {
+        real x = asReal(a), y = asReal(b);
+        switch (op) {
+            case ADD: return num(x + y);
+            case SUB: return num(x - y);
+            case MUL: return num(x * y);
+            case DIV: case IDIV:
+                if (y == 0) { error("Division by zero"); std::exit(1); }
+                return num(op == DIV ? x / y : static_cast<int>(x / y));
+            case EQ: return boolean(x == y);
+            case NE: return boolean(x != y);
+            case GT: return boolean(x > y);
+            case LT: return boolean(x < y);
+            case GE: return boolean(x >= y);
+            case LE: return boolean(x <= y);
+            default: error(std::string("Unsupported ") + realName + " op: " + opText[op]); return Value();
+        }
+    }
+    if (a.type == STRING && b.type == STRING) {
+        switch (op) {
+            case ADD: return str(*a.s + *b.s);
+            case EQ: return boolean(*a.s == *b.s);
+            case NE: return boolean(*a.s != *b.s);
+            default: error(std::string("Unsupported string op: ") + opText[op]); return Value();
+        }
+    }
+    if (a.type == STRING && (b.type == FLOAT || b.type == INT) && op == INDEX) {
+        int64_t idx = b.type == INT ? b.i : static_cast<int64_t>(b.f);
+        if (idx < 0 || idx >= static_cast<int64_t>(a.s->size())) { error("String index out of range"); return Value(); }
+        return str(std::string(1, (*a.s)[idx]));
+    }
+    if (a.type == BOOL && b.type == BOOL) {
+        switch (op) {
+            case AND: return boolean(a.b && b.b);
+            case OR: return boolean(a.b || b.b);
+            case EQ: return boolean(a.b == b.b);
+            case NE: return boolean(a.b != b.b);
+            default: error(std::string("Unsupported bool op: ") + opText[op]); return Value();
+        }
+    }
+    error(std::string("Type mismatch for op ") + opText[op] + ", with values: " + toString(a) + ", " + toString(b));
+    return Value();
+}
+
+inline Value binary(const Value& a, Op op, const Value& b) {
+    if (a.type == FLOAT && b.type == FLOAT) {
+        switch (op) {
+            case ADD: return num(a.f + b.f);
+            case SUB: return num(a.f - b.f);
+            case MUL: return num(a.f * b.f);
+            case LT: return boolean(a.f < b.f);
+            case GT: return boolean(a.f > b.f);
+            case NE: return boolean(a.f != b.f);
+            default: break;
+        }
+    }
+    if (a.type == INT && b.type == INT) {
+        switch (op) {
+            case ADD: return integer((int64_t)((uint64_t)a.i + (uint64_t)b.i));
+            case SUB: return integer((int64_t)((uint64_t)a.i - (uint64_t)b.i));
+            case MUL: return integer((int64_t)((uint64_t)a.i * (uint64_t)b.i));
+            case LT: return boolean(a.i < b.i);
+            case GT: return boolean(a.i > b.i);
+            case NE: return boolean(a.i != b.i);
+            default: break;
+        }
+    }
+    return binarySlow(a, op, b);
+}
+
+Value unary(const Value& a, Op op) {
+    switch (a.type) {
+        case FLOAT:
+            if (op == INC) return num(a.f + 1);
+            if (op == DEC) return num(a.f - 1);
+            if (op == NOT) return boolean(!(a.f != 0));
+            error(std::string("Unsupported ") + realName + " unary op: " + opText[op]); return Value();
+        case INT:
+            if (op == INC) return integer((int64_t)((uint64_t)a.i + 1));
+            if (op == DEC) return integer((int64_t)((uint64_t)a.i - 1));
+            if (op == NOT) return boolean(a.i == 0);
+            error(std::string("Unsupported int unary op: ") + opText[op]); return Value();
+        case BOOL:
+            if (op == NOT) return boolean(!a.b);
+            error(std::string("Unsupported bool unary op: ") + opText[op]); return Value();
+        case STRING:
+            if (op == NOT) return boolean(a.s->empty());
+            error(std::string("Unsupported string unary op: ") + opText[op]); return Value();
+        default: {
+            const char* names[] = { "none", realName, "int", "bool", "string" };
+            error(std::string("Unsupported type for unary op: ") + names[a.type]); return Value();
+        }
+    }
+}
+
+typedef Value (*Function)(const Value* args, int argc);
+std::vector<Function> functions; // indexed by symbol; null until defined
+
+inline Value call(int symbol, const Value* args, int argc) {
+    Function f = functions[symbol];
+    if (!f) { error("unknown function: " + symbolNames[symbol]); return Value(); }
+    return f(args, argc);
+}
+
+// parameters missing at the call site default to 0
+inline Value arg(const Value* args, int argc, int i) { return i < argc ? args[i] : num(0); }
+
+Value print(const Value* args, int argc) {
+    std::string text;
+    for (int i = 0; i < argc; i++) text += toString(args[i]);
+    std::cout << text << std::endl;
+    return num(0);
+}
+
+// a call starts with no pending error and hands its own back to the caller, as a frame push/pop does
+struct Frame {
+    bool savedError = hasErrored;
+    int savedLine = line;
+    Frame() { hasErrored = false; }
+    ~Frame() { hasErrored = savedError || hasErrored; line = savedLine; }
+};
+
+// ROS calls become C++ calls here, so deep recursion gets a large stack
+void run(void (*body)()) {
+#if defined(__unix__)
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, size_t(1) << 30);
+    pthread_t thread;
+    auto start = [](void* fn) -> void* { reinterpret_cast<void (*)()>(fn)(); return nullptr; };
+    if (pthread_create(&thread, &attr, start, reinterpret_cast<void*>(body)) == 0) { pthread_join(thread, nullptr); return; }
+#endif
+    body();
+}
+
+}
+)ROS";
+
+const char* aotOperatorNames[OPR_COUNT] = { "INDEX", "INC", "DEC", "NOT", "MUL", "DIV", "IDIV", "ADD", "SUB", "LT", "LE", "GT", "GE", "EQ", "NE", "AND", "OR" };
+
+string cppString(const string& s) {
+    string out = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; out += (char)c; }
+        else if (c >= 32 && c < 127) out += (char)c;
+        else { char buf[8]; snprintf(buf, sizeof buf, "\\%03o", c); out += buf; }
+    }
+    return out + "\"";
+}
+
+string cppValue(const ROSdatatype& v) {
+    switch (v.type()) {
+        case TYPE_FLOAT: case TYPE_DOUBLE: {
+            double x = asReal<double>(v);
+            if (!isfinite(x)) return "ros::num(" + string(isnan(x) ? "NAN" : x > 0 ? "INFINITY" : "-INFINITY") + ")";
+            char buf[64];
+            snprintf(buf, sizeof buf, "%a", x);
+            return string("ros::num(") + buf + (v.type() == TYPE_FLOAT ? "f)" : ")");
+        }
+        case TYPE_INT: return "ros::integer(" + (v.intValue() == INT64_MIN ? string("INT64_MIN") : to_string(v.intValue()) + "LL") + ")";
+        case TYPE_BOOL: return v.boolValue() ? "ros::boolean(true)" : "ros::boolean(false)";
+        case TYPE_STRING: return "ros::str(" + cppString(v.stringValue()) + ")";
+        default: return "ros::Value()";
+    }
+}
+
+struct CppTranslator {
+    const vector<Statement>& program;
+    ostringstream out {};
+    unordered_map<const functionData*, string> functionNames {};
+    int temps = 0;
+
+    string slot(const VarRef& ref) { return (ref.local ? "L[" : "G[") + to_string(ref.slot) + "]"; }
+    void line(int depth, const string& text) { out << string(depth * 4, ' ') << text << '\n'; }
+
+    // emits temporaries for node in evaluation order and returns the one holding its value; variables are
+    // bound by reference unless a call later in the statement could reassign them (a global, or the global
+    // an unassigned local falls back to)
+    string expr(const ExprNode& node, int depth, bool stable) {
+        string t = "t" + to_string(temps++);
+        switch (node.kind) {
+            case ExprNode::Literal:
+                return "K[" + to_string(node.constant) + "]";
+            case ExprNode::Variable: {
+                string global = node.var.local ? "G[" + to_string(node.symbol) + "], " : "";
+                line(depth, string(stable ? "const ros::Value& " : "ros::Value ") + t + " = ros::get(" + slot(node.var) + ", " + global + to_string(node.symbol) + ");");
+                break;
+            }
+            case ExprNode::Unary: {
+                string a = expr(*node.args[0], depth, stable);
+                line(depth, "ros::Value " + t + " = ros::unary(" + a + ", ros::" + aotOperatorNames[node.op] + ");");
+                break;
+            }
+            case ExprNode::Binary: {
+                string a = expr(*node.args[0], depth, stable);
+                string b = expr(*node.args[1], depth, stable);
+                line(depth, "ros::Value " + t + " = ros::binary(" + a + ", ros::" + aotOperatorNames[node.op] + ", " + b + ");");
+                break;
+            }
+            case ExprNode::Call: {
+                string args;
+                for (const auto& arg : node.args) args += (args.empty() ? "" : ", ") + expr(*arg, depth, stable);
+                string argv = "nullptr";
+                if (!node.args.empty()) { argv = t + "args"; line(depth, "ros::Value " + argv + "[] = { " + args + " };"); }
+                line(depth, "ros::Value " + t + " = ros::call(" + to_string(node.symbol) + ", " + argv + ", " + to_string(node.args.size()) + ");");
+                break;
+            }
+            default:
+                line(depth, "ros::error(" + cppString(node.text) + ");");
+                line(depth, "ros::Value " + t + ";");
+                break;
+        }
+        return t;
+    }
+
+    void assign(const VarRef& ref, const ExprNode& node, int depth) {
+        string value = expr(node, depth, node.callFree);
+        if (ref.slot >= 0) line(depth, slot(ref) + " = " + value + ";");
+    }
+
+    // the loop exits when its condition fails or an error is pending after the body
+    void range(int begin, int end, int depth, bool inFunction) {
+        for (int i = begin; i < end; i++) {
+            const Statement& st = program[i];
+            if (st.kind != STMT_EMPTY && st.kind != STMT_END && st.kind != STMT_GLOBAL) line(depth, "ros::line = " + to_string(i) + ";");
+            switch (st.kind) {
+                case STMT_EMPTY: case STMT_END:
+                    break;
+                case STMT_VAR:
+                    if (st.names.empty()) line(depth, "ros::error(\"invalid var syntax\");");
+                    else assign(st.targets[0], *st.exprs[0], depth);
+                    break;
+                case STMT_GLOBAL:
+                    if (st.tokens.size() < 2) { line(depth, "ros::line = " + to_string(i) + ";"); line(depth, "ros::error(\"global requires a name\");"); }
+                    break;
+                case STMT_DEF:
+                    if (st.tokens.size() < 2) line(depth, "ros::error(\"function name missing\");");
+                    else line(depth, "ros::functions[" + to_string(st.symbol) + "] = " + functionNames[st.function] + ";");
+                    i = st.endIndex;
+                    break;
+                case STMT_RETURN: {
+                    string value = expr(*st.exprs[0], depth, st.exprs[0]->callFree);
+                    line(depth, inFunction ? "return " + value + ";" : "return;");
+                    break;
+                }
+                case STMT_WHILE:
+                    if (st.exprs.empty()) line(depth, "ros::error(\"invalid while syntax\");");
+                    else {
+                        line(depth, "for (;;) {");
+                        line(depth + 1, "ros::line = " + to_string(i) + ";");
+                        string cond = expr(*st.exprs[0], depth + 1, st.exprs[0]->callFree);
+                        line(depth + 1, "if (!ros::truthy(" + cond + ")) break;");
+                        range(i + 1, st.endIndex, depth + 1, inFunction);
+                        line(depth + 1, "if (ros::hasErrored) break;");
+                        line(depth, "}");
+                    }
+                    i = st.endIndex;
+                    break;
+                case STMT_FOR:
+                    if (st.exprs.size() != 3) line(depth, "ros::error(\"for requires 3 parts\");");
+                    else {
+                        assign(st.targets[0], *st.exprs[0], depth);
+                        line(depth, "for (;;) {");
+                        line(depth + 1, "ros::line = " + to_string(i) + ";");
+                        string cond = expr(*st.exprs[1], depth + 1, st.exprs[1]->callFree);
+                        line(depth + 1, "if (!ros::truthy(" + cond + ")) break;");
+                        range(i + 1, st.endIndex, depth + 1, inFunction);
+                        line(depth + 1, "if (ros::hasErrored) break;");
+                        line(depth + 1, "ros::line = " + to_string(i) + ";");
+                        // an error in the increment still tests the condition once more
+                        assign(st.targets[1], *st.exprs[2], depth + 1);
+                        line(depth, "}");
+                    }
+                    i = st.endIndex;
+                    break;
+                case STMT_HELP: {
+                    ostringstream text;
+                    streambuf* saved = cout.rdbuf(text.rdbuf());
+                    printHelp(false);
+                    cout.rdbuf(saved);
+                    line(depth, "std::cout << " + cppString(text.str()) + ";");
+                    break;
+                }
+                case STMT_CALL:
+                    // lines naming no function are skipped, like in the interpreter
+                    line(depth, "if (ros::functions[" + to_string(st.symbol) + "]) {");
+                    if (st.callMissingSpace) {
+                        // the error abandons the innermost block: out of the loop, or out of the function
+                        line(depth + 1, "ros::error(\"function calls require a space before '('\");");
+                        if (st.parent >= 0 && program[st.parent].kind != STMT_DEF) line(depth + 1, "break;");
+                        else line(depth + 1, inFunction ? "return ros::num(0.0f);" : "return;");
+                    }
+                    else expr(*st.exprs[0], depth + 1, false);
+                    line(depth, "}");
+                    break;
+            }
+        }
+    }
+
+    void function(const functionData& func) {
+        line(0, "ros::Value " + functionNames[&func] + "(const ros::Value* args, int argc) {");
+        line(1, "ros::Frame frame;");
+        line(1, "ros::Value L[" + to_string(max(func.numSlots, 1)) + "];");
+        line(1, "(void)args; (void)argc;");
+        for (int i = 0; i < func.numArgs; i++) line(1, "L[" + to_string(i) + "] = ros::arg(args, argc, " + to_string(i) + ");");
+        range(func.bodyBegin, func.bodyEnd, 1, true);
+        line(1, "return ros::num(0.0f);");
+        line(0, "}");
+        line(0, "");
+    }
+
+    string translate() {
+        if (realType == TYPE_DOUBLE) line(0, "#define ROS_REAL double");
+        out << aotRuntime << '\n';
+        line(0, "static ros::Value G[" + to_string(max(symbolNames.size(), (size_t)1)) + "];");
+        line(0, "static const ros::Value K[] = {");
+        for (const ROSdatatype& value : constantPool) line(1, cppValue(value) + ",");
+        line(1, "ros::Value()");
+        line(0, "};");
+        line(0, "");
+
+        vector<const functionData*> defs;
+        for (int i = 0; i < (int)program.size(); i++) {
+            if (program[i].kind != STMT_DEF || !program[i].function) continue;
+            functionNames[program[i].function] = "f" + to_string(i);
+            defs.push_back(program[i].function);
+            line(0, "ros::Value f" + to_string(i) + "(const ros::Value* args, int argc);");
+        }
+        line(0, "");
+        for (const functionData* func : defs) function(*func);
+
+        line(0, "static void program() {");
+        range(0, (int)program.size(), 1, false);
+        line(0, "}");
+        line(0, "");
+        line(0, "int main() {");
+        line(1, "ros::symbolNames = {");
+        for (const string& name : symbolNames) line(2, cppString(name) + ",");
+        line(1, "};");
+        line(1, "ros::functions.assign(ros::symbolNames.size(), nullptr);");
+        line(1, "ros::functions[" + to_string(internSymbol("print")) + "] = ros::print;");
+        line(1, "ros::run(program);");
+        line(0, "}");
+        return out.str();
+    }
+};
+
+// run args[0] with args as its argv, without a shell, so paths are never interpreted; true when it exits with 0
+bool runCompiler(const vector<string>& args) {
+    vector<char*> argv;
+    for (const string& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    cout.flush();
+#if defined(__unix__) || defined(__APPLE__)
+    pid_t pid = fork();
+    if (pid < 0) { cerr << "cannot start " << args[0] << ": " << strerror(errno) << endl; return false; }
+    if (pid == 0) {
+        execvp(argv[0], argv.data());
+        cerr << "cannot run " << args[0] << ": " << strerror(errno) << endl;
+        _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) { cerr << "cannot wait for " << args[0] << ": " << strerror(errno) << endl; return false; }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#elif defined(_WIN32)
+    return _spawnvp(_P_WAIT, argv[0], argv.data()) == 0;
+#else
+    cerr << "--compile is not supported on this platform" << endl;
+    return false;
+#endif
+}
+
+// --compile out file: writes out.cpp and builds out with the local c++
+int compileToNative(const string& outPath, const string& file) {
+    ifstream in(file);
+    if (!in) { cerr << "cannot open " << file << endl; return 1; }
+    vector<string> source;
+    for (string line; getline(in, line);) source.push_back(line);
+
+    const vector<Statement>& program = compileProgram(source);
+    string cppPath = outPath + ".cpp";
+    ofstream cpp(cppPath);
+    cpp << CppTranslator { program }.translate();
+    cpp.close();
+    if (!cpp) { cerr << "cannot write " << cppPath << endl; return 1; }
+
+    vector<string> args = { "c++", "-std=c++17", "-O2", "-pthread", "-o", outPath, cppPath };
+    string shown;
+    for (const string& arg : args) shown += (shown.empty() ? "" : " ") + arg;
+    cout << shown << endl;
+    if (!runCompiler(args)) { cerr << "c++ failed" << endl; return 1; }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    functionData* bulitInPrint = newFunction();
+    bulitInPrint->isC = true;
+    bulitInPrint->numArgs = -1;
+
+    bulitInPrint->cfunc = ROSprint;
+    defineFunction(internSymbol("print"), bulitInPrint);
+
+    // --compile runs after every flag is read, so --double applies wherever it appears
+    const char* compileOut = nullptr;
+    const char* compileFile = nullptr;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--bench") return runBenchmarks(vector<string>(argv + i + 1, argv + argc));
+        if (arg == "--compile") {
+            if (i + 2 >= argc) { cerr << "usage: --compile <out> <file>" << endl; return 1; }
+            compileOut = argv[++i];
+            compileFile = argv[++i];
+        }
+        if (arg == "--no-osr") osrEnabled = false;
+        if (arg == "--double") realType = TYPE_DOUBLE;
+        if (arg.rfind("--engine=", 0) == 0 && !selectEngine(arg.substr(9))) { cerr << "unknown engine: " << arg.substr(9) << endl; return 1; }
+    }
+    if (compileOut) return compileToNative(compileOut, compileFile);
     cout << "Type 'help' for a list of cmds. \nafter typeing in the program type 'run' to run the program." << endl;
     string ask;
     vector<string> toExec;
 
-    functionData bulitInPrint;
-    bulitInPrint.isC = true;
-
-    bulitInPrint.cfunc = ROSprint;
-    functions["print"] = bulitInPrint;
-
     while (true) {
         cout << ">>> ";
-        getline(cin, ask);
+        if (!getline(cin, ask)) break;
 
         if (ask == "run") {
             auto start = chrono::high_resolution_clock::now();
 
-            
-            execBlock(toExec);
+            runProgram(toExec);
 
             auto end = chrono::high_resolution_clock::now();
             chrono::duration<double> elapsed = end - start;
@@ -895,6 +3864,10 @@ int main() {
         }
         else if (ask == "exit") {
             break;
+        }
+        else if (ask.rfind("engine ", 0) == 0) {
+            if (selectEngine(strip(ask.substr(7)))) cout << "engine: " << strip(ask.substr(7)) << endl;
+            else cout << "unknown engine, expected walker, vm, reg, jit or trace" << endl;
         }
          else {
             toExec.push_back(ask);
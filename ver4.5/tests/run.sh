@@ -0,0 +1,55 @@
+#!/bin/sh
+# usage: tests/run.sh <path to the built interpreter>
+# runs every tests/*.ros on each engine and compares program output (stdout and errors) with tests/<name>.out;
+# every tests/compile/*.ros is built with --compile and must print exactly what the interpreter prints
+ros=${1:?usage: tests/run.sh <ros binary>}
+dir=$(dirname "$0")
+failed=0
+
+# feed a program to the prompt, then drop the banner, the prompts and the timing line
+runProgram() {
+    (cat "$2"; echo run; echo exit) | "$ros" --engine="$1" $3 2>&1 | sed -e '1,2d' -e 's/^\(>>> \)*//' | grep -v '^completed running in '
+}
+
+for test in "$dir"/*.ros; do
+    name=$(basename "$test" .ros)
+    for engine in walker vm reg jit trace; do
+        if runProgram "$engine" "$test" | diff -u "$dir/$name.out" - > /dev/null; then
+            echo "ok   $name ($engine)"
+        else
+            echo "FAIL $name ($engine)"
+            runProgram "$engine" "$test" | diff -u "$dir/$name.out" -
+            failed=1
+        fi
+    done
+done
+
+# the translated programs carry their own copy of the operator semantics, so compare them with the
+# interpreter in both numeric modes
+if command -v c++ > /dev/null; then
+    out=$(mktemp -d)
+    trap 'rm -rf "$out"' EXIT
+    for test in "$dir"/compile/*.ros; do
+        name=$(basename "$test" .ros)
+        for mode in "" --double; do
+            label="$name (compiled${mode:+ $mode})"
+            runProgram walker "$test" "$mode" > "$out/expected"
+            if ! "$ros" --compile "$out/$name" "$test" $mode > /dev/null; then
+                echo "FAIL $label: --compile failed"
+                failed=1
+                continue
+            fi
+            "$out/$name" > "$out/actual" 2>&1
+            if diff -u "$out/expected" "$out/actual" > /dev/null; then
+                echo "ok   $label"
+            else
+                echo "FAIL $label"
+                diff -u "$out/expected" "$out/actual"
+                failed=1
+            fi
+        done
+    done
+else
+    echo "skip compile tests: no c++ on PATH"
+fi
+exit $failed